@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <err.h>
 #include <mpi.h>
+#include <vector>
 
 namespace UserMpi
 {
@@ -24,6 +25,25 @@ public:
         m_error = MPI_Init(argc, argv);
     }
 
+    MPI(int* argc, char** argv[], int required):
+        m_commSize{},
+        m_rank{},
+        m_buffer{},
+        m_len{},
+        m_error{}
+    {
+        setbuf(stdout, nullptr);
+
+        int provided = MPI_THREAD_SINGLE;
+
+        m_error = MPI_Init_thread(argc, argv, required, &provided);
+
+        if (!m_error && provided < required)
+        {
+            warnx("MPI: requested thread support level %d, provided %d", required, provided);
+        }
+    }
+
     MPI(const MPI& mpi) = delete;
 
     ~MPI()
@@ -76,6 +96,95 @@ public:
         m_error = MPI_Comm_rank(comm, &m_rank);
     }
 
+    inline int commRank(MPI_Comm comm)
+    {
+        int rank = 0;
+
+        m_error = MPI_Comm_rank(comm, &rank);
+
+        return rank;
+    }
+
+    inline int commSize(MPI_Comm comm)
+    {
+        int size = 0;
+
+        m_error = MPI_Comm_size(comm, &size);
+
+        return size;
+    }
+
+    inline void commSplit(MPI_Comm comm, int color, int key, MPI_Comm* newcomm)
+    {
+        m_error = MPI_Comm_split(comm, color, key, newcomm);
+    }
+
+    inline void commFree(MPI_Comm* comm)
+    {
+        m_error = MPI_Comm_free(comm);
+    }
+
+    inline void commSplitType(MPI_Comm comm, int split_type, int key, MPI_Comm* newcomm)
+    {
+        m_error = MPI_Comm_split_type(comm, split_type, key, MPI_INFO_NULL, newcomm);
+    }
+
+    /* The rank in comm_b of the process with the rank rank_a in comm_a, MPI_UNDEFINED if none */
+    inline int translateRank(MPI_Comm comm_a, int rank_a, MPI_Comm comm_b)
+    {
+        MPI_Group group_a = MPI_GROUP_NULL;
+        MPI_Group group_b = MPI_GROUP_NULL;
+
+        int rank_b = MPI_UNDEFINED;
+
+        if ((m_error = MPI_Comm_group(comm_a, &group_a))) return rank_b;
+        if ((m_error = MPI_Comm_group(comm_b, &group_b))) return rank_b;
+
+        m_error = MPI_Group_translate_ranks(group_a, 1, &rank_a, group_b, &rank_b);
+
+        MPI_Group_free(&group_a);
+        MPI_Group_free(&group_b);
+
+        return rank_b;
+    }
+
+    /* The group of the ranks of comm listed in ranks */
+    inline void groupIncl(MPI_Comm comm, int count, const int* ranks, MPI_Group* newgroup)
+    {
+        MPI_Group group = MPI_GROUP_NULL;
+
+        if ((m_error = MPI_Comm_group(comm, &group))) return;
+
+        m_error = MPI_Group_incl(group, count, ranks, newgroup);
+
+        MPI_Group_free(&group);
+    }
+
+    inline void cartCreate(MPI_Comm comm, int ndims, const int* dims, const int* periods, int reorder, MPI_Comm* newcomm)
+    {
+        m_error = MPI_Cart_create(comm, ndims, dims, periods, reorder, newcomm);
+    }
+
+    inline void cartShift(MPI_Comm comm, int direction, int disp, int* source, int* dest)
+    {
+        m_error = MPI_Cart_shift(comm, direction, disp, source, dest);
+    }
+
+    inline void cartGet(MPI_Comm comm, int maxdims, int* dims, int* periods, int* coords)
+    {
+        m_error = MPI_Cart_get(comm, maxdims, dims, periods, coords);
+    }
+
+    inline void cartCoords(MPI_Comm comm, int rank, int maxdims, int* coords)
+    {
+        m_error = MPI_Cart_coords(comm, rank, maxdims, coords);
+    }
+
+    inline void dimsCreate(int nnodes, int ndims, int* dims)
+    {
+        m_error = MPI_Dims_create(nnodes, ndims, dims);
+    }
+
     inline void send(const void* buffer, int count, MPI_Datatype type, int dst, int tag, MPI_Comm comm)
     {
         m_error = MPI_Send(buffer, count, type, dst, tag, comm);
@@ -117,6 +226,26 @@ public:
         m_error = MPI_Irecv(buffer, count, type, dst, tag, comm, request);
     }
 
+    inline void sendInit(const void* buffer, int count, MPI_Datatype type, int dst, int tag, MPI_Comm comm, MPI_Request* request)
+    {
+        m_error = MPI_Send_init(buffer, count, type, dst, tag, comm, request);
+    }
+
+    inline void recvInit(void* buffer, int count, MPI_Datatype type, int src, int tag, MPI_Comm comm, MPI_Request* request)
+    {
+        m_error = MPI_Recv_init(buffer, count, type, src, tag, comm, request);
+    }
+
+    inline void startall(int count, MPI_Request* requests)
+    {
+        m_error = MPI_Startall(count, requests);
+    }
+
+    inline void requestFree(MPI_Request* request)
+    {
+        m_error = MPI_Request_free(request);
+    }
+
     inline void wait(MPI_Request* request = nullptr)
     {
         if (request == nullptr)
@@ -125,6 +254,11 @@ public:
         m_error = MPI_Wait(request, &m_status);
     }
 
+    inline void waitall(int count, MPI_Request* requests)
+    {
+        m_error = MPI_Waitall(count, requests, MPI_STATUSES_IGNORE);
+    }
+
     inline void probe(int src, int tag, MPI_Comm comm)
     {
         m_error = MPI_Probe(src, tag, comm, &m_status);
@@ -135,6 +269,21 @@ public:
         m_error = MPI_Reduce(sendbuf, recvbuf, count, datatype, op, root, comm);
     }
 
+    inline void allreduce(const void* sendbuf, void* recvbuf, int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
+    {
+        m_error = MPI_Allreduce(sendbuf, recvbuf, count, datatype, op, comm);
+    }
+
+    inline void allgather(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm)
+    {
+        m_error = MPI_Allgather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+    }
+
+    inline void alltoallv(const void* sendbuf, const int* sendcounts, const int* sdispls, MPI_Datatype sendtype, void* recvbuf, const int* recvcounts, const int* rdispls, MPI_Datatype recvtype, MPI_Comm comm)
+    {
+        m_error = MPI_Alltoallv(sendbuf, sendcounts, sdispls, sendtype, recvbuf, recvcounts, rdispls, recvtype, comm);
+    }
+
     inline void scatter(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf, int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm)
     {
         m_error = MPI_Scatter(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm);
@@ -155,11 +304,151 @@ public:
         m_error = MPI_Gatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs, recvtype, root, comm);
     }
 
+    inline void ineighborAlltoall(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm, MPI_Request* request)
+    {
+        m_error = MPI_Ineighbor_alltoall(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm, request);
+    }
+
     inline void barrier(MPI_Comm comm)
     {
         m_error = MPI_Barrier(comm);
     }
 
+    inline void typeContiguous(int count, MPI_Datatype oldtype, MPI_Datatype* newtype)
+    {
+        m_error = MPI_Type_contiguous(count, oldtype, newtype);
+    }
+
+    inline void typeVector(int count, int blocklength, int stride, MPI_Datatype oldtype, MPI_Datatype* newtype)
+    {
+        m_error = MPI_Type_vector(count, blocklength, stride, oldtype, newtype);
+    }
+
+    inline void typeSubarray(int ndims, const int* sizes, const int* subsizes, const int* starts, MPI_Datatype oldtype, MPI_Datatype* newtype)
+    {
+        m_error = MPI_Type_create_subarray(ndims, sizes, subsizes, starts, MPI_ORDER_C, oldtype, newtype);
+    }
+
+    inline void typeResized(MPI_Datatype oldtype, MPI_Aint lb, MPI_Aint extent, MPI_Datatype* newtype)
+    {
+        m_error = MPI_Type_create_resized(oldtype, lb, extent, newtype);
+    }
+
+    inline void typeCommit(MPI_Datatype* datatype)
+    {
+        m_error = MPI_Type_commit(datatype);
+    }
+
+    inline void typeFree(MPI_Datatype* datatype)
+    {
+        m_error = MPI_Type_free(datatype);
+    }
+
+    inline void winCreate(void* base, MPI_Aint size, int disp_unit, MPI_Comm comm, MPI_Win* win)
+    {
+        m_error = MPI_Win_create(base, size, disp_unit, MPI_INFO_NULL, comm, win);
+    }
+
+    inline void winAllocateShared(MPI_Aint size, int disp_unit, MPI_Comm comm, void* baseptr, MPI_Win* win)
+    {
+        m_error = MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, comm, baseptr, win);
+    }
+
+    inline void winSharedQuery(MPI_Win win, int rank, MPI_Aint* size, int* disp_unit, void* baseptr)
+    {
+        m_error = MPI_Win_shared_query(win, rank, size, disp_unit, baseptr);
+    }
+
+    inline void winLockAll(MPI_Win win, int assert = 0)
+    {
+        m_error = MPI_Win_lock_all(assert, win);
+    }
+
+    inline void winUnlockAll(MPI_Win win)
+    {
+        m_error = MPI_Win_unlock_all(win);
+    }
+
+    inline void winSync(MPI_Win win)
+    {
+        m_error = MPI_Win_sync(win);
+    }
+
+    inline void winFree(MPI_Win* win)
+    {
+        m_error = MPI_Win_free(win);
+    }
+
+    inline void winPost(MPI_Group group, MPI_Win win, int assert = 0)
+    {
+        m_error = MPI_Win_post(group, assert, win);
+    }
+
+    inline void winStart(MPI_Group group, MPI_Win win, int assert = 0)
+    {
+        m_error = MPI_Win_start(group, assert, win);
+    }
+
+    inline void winComplete(MPI_Win win)
+    {
+        m_error = MPI_Win_complete(win);
+    }
+
+    inline void winWait(MPI_Win win)
+    {
+        m_error = MPI_Win_wait(win);
+    }
+
+    inline void winFlush(int rank, MPI_Win win)
+    {
+        m_error = MPI_Win_flush(rank, win);
+    }
+
+    inline void put(const void* buffer, int count, MPI_Datatype type, int dst, MPI_Aint disp, MPI_Win win)
+    {
+        m_error = MPI_Put(buffer, count, type, dst, disp, count, type, win);
+    }
+
+    inline void accumulate(const void* buffer, int count, MPI_Datatype type, int dst, MPI_Aint disp, MPI_Op op, MPI_Win win)
+    {
+        m_error = MPI_Accumulate(buffer, count, type, dst, disp, count, type, op, win);
+    }
+
+    inline void fetchAndOp(const void* buffer, void* result, MPI_Datatype type, int dst, MPI_Aint disp, MPI_Op op, MPI_Win win)
+    {
+        m_error = MPI_Fetch_and_op(buffer, result, type, dst, disp, op, win);
+    }
+
+    inline void fileOpen(MPI_Comm comm, const char* filename, int amode, MPI_File* file)
+    {
+        m_error = MPI_File_open(comm, filename, amode, MPI_INFO_NULL, file);
+    }
+
+    inline void fileSetSize(MPI_File file, MPI_Offset size)
+    {
+        m_error = MPI_File_set_size(file, size);
+    }
+
+    inline void fileSetView(MPI_File file, MPI_Offset disp, MPI_Datatype etype, MPI_Datatype filetype)
+    {
+        m_error = MPI_File_set_view(file, disp, etype, filetype, "native", MPI_INFO_NULL);
+    }
+
+    inline void fileWriteAt(MPI_File file, MPI_Offset offset, const void* buffer, int count, MPI_Datatype datatype)
+    {
+        m_error = MPI_File_write_at(file, offset, buffer, count, datatype, &m_status);
+    }
+
+    inline void fileWriteAll(MPI_File file, const void* buffer, int count, MPI_Datatype datatype)
+    {
+        m_error = MPI_File_write_all(file, buffer, count, datatype, &m_status);
+    }
+
+    inline void fileClose(MPI_File* file)
+    {
+        m_error = MPI_File_close(file);
+    }
+
     inline int getCount(MPI_Datatype datatype)
     {
         int count = 0;
@@ -193,6 +482,83 @@ private:
 
 }; // class MPI
 
+/* The MPI datatype of T */
+template <typename T>
+inline MPI_Datatype TypeOf();
+
+template <>
+inline MPI_Datatype TypeOf<double>()
+{
+    return MPI_DOUBLE;
+}
+
+template <>
+inline MPI_Datatype TypeOf<float>()
+{
+    return MPI_FLOAT;
+}
+
+/**
+ * @brief Persistent sends and receives to a fixed set of neighbours: built once, then started
+ *        and completed on every step
+ * @note  The buffers are bound when the plan is built, the caller refills the send buffers
+ *        before every start and reads the receive buffers after every wait.
+ */
+class Plan
+{
+public:
+    Plan() :
+        m_requests{}
+    {}
+
+    Plan(const Plan& plan) = delete;
+
+    ~Plan()
+    {
+        for (MPI_Request& request : m_requests)
+        {
+            if (request != MPI_REQUEST_NULL)
+            {
+                MPI_Request_free(&request);
+            }
+        }
+    }
+
+    inline void send(MPI* mpi, const void* buffer, int count, MPI_Datatype type, int dst, int tag, MPI_Comm comm)
+    {
+        m_requests.push_back(MPI_REQUEST_NULL);
+
+        mpi->sendInit(buffer, count, type, dst, tag, comm, &m_requests.back());
+    }
+
+    inline void recv(MPI* mpi, void* buffer, int count, MPI_Datatype type, int src, int tag, MPI_Comm comm)
+    {
+        m_requests.push_back(MPI_REQUEST_NULL);
+
+        mpi->recvInit(buffer, count, type, src, tag, comm, &m_requests.back());
+    }
+
+    inline void start(MPI* mpi)
+    {
+        mpi->startall(m_requests.size(), m_requests.data());
+    }
+
+    /* Completes every request, the plan can be started again */
+    inline void wait(MPI* mpi)
+    {
+        mpi->waitall(m_requests.size(), m_requests.data());
+    }
+
+    inline size_t size() const
+    {
+        return m_requests.size();
+    }
+
+private:
+    std::vector<MPI_Request> m_requests;
+
+}; // class Plan
+
 } // UserMpi
 
 #endif // USER_MPI_H
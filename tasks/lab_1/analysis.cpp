@@ -0,0 +1,110 @@
+#include "analysis.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+
+void Analysis::Open(const char* path, int inversed, size_t every, size_t K, size_t cols, double tau, double h,
+                    const Probe* probes, size_t count)
+{
+    size_t rows = (K - 1) / every + 1;
+
+    m_path     = path;
+    m_open     = true;
+    m_inversed = inversed;
+    m_every    = every;
+    m_cols     = cols;
+    m_tau      = tau;
+    m_h        = h;
+
+    m_min.assign(rows,  HUGE_VAL);
+    m_max.assign(rows, -HUGE_VAL);
+    m_sum.assign(rows,  0);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        /* x is the marching axis in the inversed mode */
+        double along  = inversed ? probes[i].x : probes[i].t;
+        double across = inversed ? probes[i].t : probes[i].x;
+
+        size_t row = std::min<size_t>(lround(along  / tau), K    - 1);
+        size_t col = std::min<size_t>(lround(across / h),   cols - 1);
+
+        m_points.push_back({probes[i], row, col});
+    }
+
+    m_values.assign(count, 0);
+}
+
+int Analysis::Report(UserMpi::MPI* master, MPI_Comm comm)
+{
+    bool root = (master->commRank(comm) == 0);
+    if (master->check()) return 1;
+
+    /* The root reduces in place, the other ranks only send */
+    struct
+    {
+        std::vector<double>* values;
+        MPI_Op op;
+    }
+    const reductions[] =
+    {
+        {&m_min,    MPI_MIN},
+        {&m_max,    MPI_MAX},
+        {&m_sum,    MPI_SUM},
+        {&m_values, MPI_SUM},
+    };
+
+    for (const auto& reduction : reductions)
+    {
+        std::vector<double>& values = *reduction.values;
+
+        master->reduce(root ? MPI_IN_PLACE : values.data(), root ? values.data() : nullptr,
+                       values.size(), MPI::DOUBLE, reduction.op, 0, comm);
+        if (master->check()) return 1;
+    }
+
+    if (!root)
+    {
+        return 0;
+    }
+
+    double min = *std::min_element(m_min.begin(), m_min.end());
+    double max = *std::max_element(m_max.begin(), m_max.end());
+    double sum = 0;
+
+    for (double value : m_sum)
+    {
+        sum += value;
+    }
+
+    printf("Min: %lg\n", min);
+    printf("Max: %lg\n", max);
+    printf("Linf: %lg\n", std::max(fabs(min), fabs(max)));
+    printf("L2: %lg\n", sqrt(sum * m_h * m_tau * m_every));
+
+    for (size_t p = 0; p < m_points.size(); p++)
+    {
+        printf("Probe (%lg, %lg): %lg\n", m_points[p].probe.x, m_points[p].probe.t, m_values[p]);
+    }
+
+    return m_path ? Write() : 0;
+}
+
+/* One line per analysed layer: its coordinate along the marching axis, min, max and L2 norm */
+int Analysis::Write() const
+{
+    FILE* file = fopen(m_path, "w");
+    if (!file) return 1;
+
+    fprintf(file, "# %s min max l2\n", m_inversed ? "x" : "t");
+
+    for (size_t r = 0; r < m_sum.size(); r++)
+    {
+        fprintf(file, "%lg %lg %lg %lg\n", r * m_every * m_tau, m_min[r], m_max[r], sqrt(m_sum[r] * m_h));
+    }
+
+    fclose(file);
+
+    return 0;
+}
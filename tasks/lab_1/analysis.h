@@ -0,0 +1,119 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <stddef.h>
+#include <vector>
+#include <algorithm>
+
+#include "user_mpi.h"
+
+/**
+ * @brief In-situ analysis: the extrema and the L2 norm of the analysed layers and the values
+ *        at a few probe points, computed by every rank on its own columns and reduced to rank 0
+ * @note  Rank 0 keeps three values per analysed layer instead of the field. The totals cover
+ *        the analysed layers only, i.e. every N-th one with --stream N.
+ */
+class Analysis
+{
+public:
+    struct Probe
+    {
+        double x;
+        double t;
+    };
+
+    Analysis() :
+        m_path{nullptr},
+        m_open{false},
+        m_inversed{0},
+        m_every{1},
+        m_cols{0},
+        m_tau{0},
+        m_h{0}
+    {}
+
+    Analysis(const Analysis& analysis) = delete;
+
+    /**
+     * @brief Rows go along the marching axis with the step tau, columns along the split one with the step h
+     * @note  The probes are in (x, t), the nearest grid node is taken
+     */
+    void Open(const char* path, int inversed, size_t every, size_t K, size_t cols, double tau, double h,
+              const Probe* probes, size_t count);
+
+    inline bool IsOpen() const
+    {
+        return m_open;
+    }
+
+    /* The layer k is final: the columns [start, start + part) of it are in row */
+    template <typename T>
+    void Add(size_t k, const T* row, size_t start, size_t part)
+    {
+        size_t end = std::min(start + part, m_cols);
+
+        if (k % m_every == 0 && start < end)
+        {
+            size_t r = k / m_every;
+
+            double min = m_min[r];
+            double max = m_max[r];
+            double sum = m_sum[r];
+
+            for (size_t i = 0; i < end - start; i++)
+            {
+                double value = row[i];
+
+                min  = std::min(min, value);
+                max  = std::max(max, value);
+                sum += value * value;
+            }
+
+            m_min[r] = min;
+            m_max[r] = max;
+            m_sum[r] = sum;
+        }
+
+        for (size_t p = 0; p < m_points.size(); p++)
+        {
+            if (m_points[p].row == k && start <= m_points[p].col && m_points[p].col < end)
+            {
+                m_values[p] = row[m_points[p].col - start];
+            }
+        }
+    }
+
+    /* Collective over comm, rank 0 prints the totals and writes the layers */
+    int Report(UserMpi::MPI* master, MPI_Comm comm);
+
+private:
+    struct Point
+    {
+        Probe  probe;
+        size_t row;
+        size_t col;
+    };
+
+    int Write() const;
+
+    const char* m_path;
+    bool        m_open;
+
+    int    m_inversed;
+    size_t m_every;
+    size_t m_cols;
+
+    double m_tau;
+    double m_h;
+
+    /* Per analysed layer, local until Report */
+    std::vector<double> m_min;
+    std::vector<double> m_max;
+    std::vector<double> m_sum; // of the squares
+
+    std::vector<Point>  m_points;
+    std::vector<double> m_values; // zero on the ranks that do not own the probe
+
+}; // class Analysis
+
+#endif // ANALYSIS_H
@@ -0,0 +1,255 @@
+#include <map>
+#include <tuple>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <benchmark/benchmark.h>
+
+#include "user_mpi.h"
+#include "worker.h"
+#include "config.h"
+
+/**
+ * @brief Scaling of the lab_1 Worker over rank counts, problem sizes and modes
+ * @note  Run under mpirun, every rank runs every benchmark: the first "ranks" ranks solve the
+ *        problem on their own communicator, the others wait. The iteration time is the slowest
+ *        rank, so the iteration count is fixed for all ranks to stay in step.
+ *        Only rank 0 reports, e.g.
+ *        mpirun -np 4 lab_1_benchmark --benchmark_out=benchmark_lab_1.csv --benchmark_out_format=csv
+ */
+
+static constexpr int kIterations = 3;
+
+/* Extent of every axis in percents of the preset */
+static constexpr int kSizes[] = {10, 20, 40};
+
+static UserMpi::MPI* master = nullptr;
+
+/* Time of one rank of every (preset, size, weak) for the efficiency */
+static std::map<std::tuple<int, int, int>, double> serial;
+
+/* The reporter of the ranks other than 0 */
+class Silent : public benchmark::BenchmarkReporter
+{
+public:
+    bool ReportContext(const Context&) override
+    {
+        return true;
+    }
+
+    void ReportRuns(const std::vector<Run>&) override
+    {}
+};
+
+enum Timer
+{
+    Total,
+    Compute,
+    Wait,
+    Gather,
+    Timers
+};
+
+/* In the weak scaling the split axis grows with the ranks: x, or t in the inversed mode */
+static Config MakeConfig(int preset, int size, int ranks, bool weak)
+{
+    Config config{};
+
+    config.problem = Equation::presets[preset].problem;
+    config.quiet   = true;
+
+    bool inversed = config.problem.a * config.problem.tau / config.problem.h >= 1;
+
+    config.problem.X *= size / 100.0 * ((weak && !inversed) ? ranks : 1);
+    config.problem.T *= size / 100.0 * ((weak &&  inversed) ? ranks : 1);
+
+    /* About a hundred stored layers, the gather moves the same amount of data in every mode */
+    size_t layers = inversed ? config.problem.M() : config.problem.K();
+
+    config.stream  = std::max<size_t>(1, layers / 100);
+    config.collect = Collect::Gather;
+
+    return config;
+}
+
+static void Solve(benchmark::State& state)
+{
+    int preset = state.range(0);
+    int size   = state.range(1);
+    int ranks  = state.range(2);
+    int weak   = state.range(3);
+
+    int rank = master->getRank();
+
+    Config config = MakeConfig(preset, size, ranks, weak);
+
+    MPI_Comm part = MPI_COMM_NULL;
+    MPI_Comm comm = MPI_COMM_NULL;
+
+    master->commSplit(MPI_COMM_WORLD, (rank < ranks) ? 0 : MPI_UNDEFINED, rank, &part);
+    if (master->check())
+    {
+        state.SkipWithError("MPI_Comm_split failed");
+        return;
+    }
+
+    /* The same line of ranks as lab_1 builds */
+    if (part != MPI_COMM_NULL)
+    {
+        int periods[1] = {0};
+
+        master->cartCreate(part, 1, &ranks, periods, 1, &comm);
+        master->commFree(&part);
+
+        rank = master->commRank(comm);
+    }
+
+    double sum[Timers] = {};
+
+    for (auto _ : state)
+    {
+        double local[Timers] = {};
+        double times[Timers] = {};
+
+        if (comm != MPI_COMM_NULL)
+        {
+            Worker worker(rank, ranks, config, comm);
+            worker.Init(master);
+
+            master->barrier(comm);
+
+            double start = MPI::Wtime();
+
+            worker.FillInitialConditions();
+            worker.FillFirstLine(master);
+            worker.FillOtherLines(master);
+
+            double filled = MPI::Wtime();
+
+            worker.Gather(master);
+
+            double end = MPI::Wtime();
+
+            local[Total]   = end - start;
+            local[Wait]    = worker.GetStats().wait;
+            local[Compute] = filled - start - local[Wait];
+            local[Gather]  = end - filled;
+        }
+
+        master->allreduce(local, times, Timers, MPI::DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+        state.SetIterationTime(times[Total]);
+
+        for (int timer = 0; timer < Timers; timer++)
+        {
+            sum[timer] += times[timer];
+        }
+    }
+
+    if (comm != MPI_COMM_NULL)
+    {
+        master->commFree(&comm);
+    }
+
+    double time  = sum[Total] / state.iterations();
+    double cells = static_cast<double>(config.problem.M()) * config.problem.K();
+
+    if (ranks == 1)
+    {
+        serial[{preset, size, weak}] = time;
+    }
+
+    /* Strong: T1 / (p * Tp), weak: T1 / Tp with p times more cells */
+    auto found = serial.find({preset, size, weak});
+
+    if (found != serial.end())
+    {
+        state.counters["efficiency"] = found->second / time / (weak ? 1 : ranks);
+    }
+
+    state.counters["cells_per_second"] = benchmark::Counter(cells * state.iterations(), benchmark::Counter::kIsRate);
+
+    state.counters["compute"]   = sum[Compute] / state.iterations();
+    state.counters["halo_wait"] = sum[Wait]    / state.iterations();
+    state.counters["gather"]    = sum[Gather]  / state.iterations();
+
+    state.SetLabel(std::string(Equation::presets[preset].name) + (weak ? " weak" : " strong"));
+}
+
+/* 1, 2, 4, ... ranks and the whole world */
+static std::vector<int64_t> RankCounts(int size)
+{
+    std::vector<int64_t> counts;
+
+    for (int ranks = 1; ranks < size; ranks *= 2)
+    {
+        counts.push_back(ranks);
+    }
+
+    counts.push_back(size);
+
+    return counts;
+}
+
+int main(int argc, char** argv)
+{
+    UserMpi::MPI mpi(&argc, &argv, MPI_THREAD_FUNNELED);
+    if (mpi.check()) return 1;
+
+    mpi.setRank(MPI_COMM_WORLD);
+    if (mpi.check()) return 1;
+
+    mpi.setCommSize(MPI_COMM_WORLD);
+    if (mpi.check()) return 1;
+
+    master = &mpi;
+
+    /* The other ranks must not open the output file of rank 0 */
+    if (mpi.getRank() != 0)
+    {
+        int kept = 0;
+
+        for (int i = 0; i < argc; i++)
+        {
+            if (strncmp(argv[i], "--benchmark_out", strlen("--benchmark_out")) != 0)
+            {
+                argv[kept++] = argv[i];
+            }
+        }
+
+        argc = kept;
+    }
+
+    benchmark::Initialize(&argc, argv);
+
+    std::vector<int64_t> presets;
+    std::vector<int64_t> sizes(std::begin(kSizes), std::end(kSizes));
+
+    for (size_t preset = 0; preset < sizeof(Equation::presets) / sizeof(Equation::presets[0]); preset++)
+    {
+        presets.push_back(preset);
+    }
+
+    /* The first argument varies fastest, so the runs on one rank come before the others */
+    benchmark::RegisterBenchmark("Solve", Solve)
+        ->ArgsProduct({presets, sizes, RankCounts(mpi.getCommSize()), {0, 1}})
+        ->ArgNames({"preset", "size", "ranks", "weak"})
+        ->Iterations(kIterations)
+        ->Unit(benchmark::kMillisecond)
+        ->UseManualTime();
+
+    if (mpi.getRank() == 0)
+    {
+        benchmark::RunSpecifiedBenchmarks();
+    }
+    else
+    {
+        Silent silent;
+
+        benchmark::RunSpecifiedBenchmarks(&silent);
+    }
+
+    benchmark::Shutdown();
+
+    return 0;
+}
@@ -0,0 +1,479 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+
+static int ParseSize(const char* str, size_t* value)
+{
+    char* end = nullptr;
+
+    errno = 0;
+    unsigned long result = strtoul(str, &end, 10);
+
+    if ((errno == ERANGE) || (*end != '\0') || (end == str))
+        return 1;
+
+    *value = result;
+
+    return 0;
+}
+
+static int ParseDouble(const char* str, double* value)
+{
+    char* end = nullptr;
+
+    errno = 0;
+    double result = strtod(str, &end);
+
+    if ((errno == ERANGE) || (*end != '\0') || (end == str))
+        return 1;
+
+    *value = result;
+
+    return 0;
+}
+
+/* "x,t" */
+static int ParseProbe(const char* str, Analysis::Probe* probe)
+{
+    char* end = nullptr;
+
+    errno = 0;
+    probe->x = strtod(str, &end);
+
+    if ((errno == ERANGE) || (*end != ',') || (end == str) || probe->x < 0)
+        return 1;
+
+    return ParseDouble(end + 1, &probe->t) || probe->t < 0;
+}
+
+static int ParseChoice(const char* str, const char* const* names, int* value)
+{
+    for (int i = 0; names[i]; i++)
+    {
+        if (strcmp(str, names[i]) == 0)
+        {
+            *value = i;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int ParsePreset(const char* str, Equation::Problem* problem)
+{
+    for (const Equation::Preset& preset : Equation::presets)
+    {
+        if (strcmp(str, preset.name) == 0)
+        {
+            *problem = preset.problem;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void PrintUsage(const char* name)
+{
+    printf("Usage: %s [options] [output file]\n"
+           "Options:\n"
+           "  --halo <s>    exchange a ghost zone of s columns every s steps\n"
+           "  --stream <N>  keep a ring of time layers and store every N-th layer\n"
+           "  --collect <gather|file>\n"
+           "                collect the field on rank 0 or write it from every rank with MPI-IO\n"
+           "  --format <text|binary>\n"
+           "                output format, the binary one can be mapped directly\n"
+           "  --exchange <neighbor|persistent|shared|pscw|passive>\n"
+           "                halo exchange with a neighbourhood collective, persistent requests,\n"
+           "                direct reads from the neighbours' memory on the same node\n"
+           "                or one-sided puts synchronised with PSCW or passive target\n"
+           "  --threads <n> split the layer of every rank between n OpenMP threads\n"
+           "  --wavefront <P>\n"
+           "                pipeline the layers over P stages of ranks, the rest split the columns\n"
+           "  --chunk <w>   columns per message of the wavefront\n"
+           "  --parareal <c>\n"
+           "                split the steps into a slice per rank, iterate Parareal\n"
+           "                with a coarse step of c steps\n"
+           "  --tolerance <eps>\n"
+           "                stop Parareal once the states change by no more than eps\n"
+           "  --plane <b>   solve u_t + a * u_x + b * u_y = f on a 2D grid of ranks,\n"
+           "                only the last layer is written\n"
+           "  --Y <Y>       width of the plane, X by default\n"
+           "  --rebalance <N>\n"
+           "                every N steps move columns from the slow ranks to the fast ones\n"
+           "  --preset <slow|fast|slow-inversed|fast-inversed>\n"
+           "                problem parameters, slow by default\n"
+           "  --a <a>       advection speed\n"
+           "  --X <X>       length of the domain\n"
+           "  --T <T>       duration\n"
+           "  --h <h>       space step\n"
+           "  --tau <tau>   time step\n"
+           "  --precision <double|float|mixed>\n"
+           "                store and compute the layers in double, in float, or store float\n"
+           "                and compute double, the reduced ones report the error against double\n"
+           "  --source <batched|scalar>\n"
+           "                evaluate the source term a row at a time with SIMD or cell by cell\n"
+           "  --table <path>\n"
+           "                precomputed source term, built if missing or made for another grid\n"
+           "  --ensemble <path>\n"
+           "                solve every case \"a [wave [decay]]\" of the file at once,\n"
+           "                case e is written to <output file>.e\n"
+           "  --decimate <s>\n"
+           "                store every s-th column of the stored layers\n"
+           "  --analysis <path>\n"
+           "                reduce the extrema and norms of the stored layers in situ,\n"
+           "                rank 0 writes one line per layer\n"
+           "  --probe <x,t> report the value at the point, up to %lu times\n", name, Config::kProbes);
+}
+
+int ParseConfig(int argc, char* argv[], Config* config, bool verbose)
+{
+    *config = Config{};
+
+    config->problem = Equation::problem;
+
+    opterr = verbose;
+
+    static const struct option options[] = 
+    {
+        {"halo",      required_argument, nullptr, 'H'},
+        {"stream",    required_argument, nullptr, 'S'},
+        {"collect",   required_argument, nullptr, 'C'},
+        {"format",    required_argument, nullptr, 'F'},
+        {"exchange",  required_argument, nullptr, 'X'},
+        {"threads",   required_argument, nullptr, 'T'},
+        {"wavefront", required_argument, nullptr, 'W'},
+        {"chunk",     required_argument, nullptr, 'K'},
+        {"parareal",  required_argument, nullptr, 'G'},
+        {"tolerance", required_argument, nullptr, 'O'},
+        {"plane",     required_argument, nullptr, 'B'},
+        {"Y",         required_argument, nullptr, 'y'},
+        {"rebalance", required_argument, nullptr, 'R'},
+        {"preset",    required_argument, nullptr, 'P'},
+        {"a",         required_argument, nullptr, 'a'},
+        {"X",         required_argument, nullptr, 'x'},
+        {"T",         required_argument, nullptr, 't'},
+        {"h",         required_argument, nullptr, 'd'},
+        {"tau",       required_argument, nullptr, 'u'},
+        {"source",    required_argument, nullptr, 'E'},
+        {"precision", required_argument, nullptr, 'r'},
+        {"table",     required_argument, nullptr, 'L'},
+        {"ensemble",  required_argument, nullptr, 'e'},
+        {"decimate",  required_argument, nullptr, 'D'},
+        {"analysis",  required_argument, nullptr, 'A'},
+        {"probe",     required_argument, nullptr, 'p'},
+        {"help",      no_argument,       nullptr, 'h'},
+        {nullptr,     0,                 nullptr,  0 }
+    };
+
+    static const char* const collects[]  = {"gather",   "file",       nullptr};
+    static const char* const formats[]   = {"text",     "binary",     nullptr};
+    static const char* const sources[]   = {"batched",  "scalar",     nullptr};
+    static const char* const precisions[] = {"double",  "float",      "mixed", nullptr};
+    static const char* const exchanges[] = {"neighbor", "persistent", "shared", "pscw", "passive", nullptr};
+
+    struct
+    {
+        int         option;
+        double*     value;
+        const char* name;
+    } 
+    const parameters[] =
+    {
+        {'a', &config->problem.a,   "advection speed"},
+        {'x', &config->problem.X,   "domain length"  },
+        {'t', &config->problem.T,   "duration"       },
+        {'d', &config->problem.h,   "space step"     },
+        {'u', &config->problem.tau, "time step"      },
+    };
+
+    /* A preset sets every parameter, so the single ones are applied after all options are read */
+    bool   given[sizeof(parameters) / sizeof(parameters[0])] = {};
+    double values[sizeof(parameters) / sizeof(parameters[0])] = {};
+
+    int option = 0;
+    int choice = 0;
+
+    while ((option = getopt_long(argc, argv, "h", options, nullptr)) != -1)
+    {
+        switch (option)
+        {
+            case 'H':
+                if (ParseSize(optarg, &config->halo)) 
+                {
+                    if (verbose) printf("Invalid halo width: %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'S':
+                if (ParseSize(optarg, &config->stream)) 
+                {
+                    if (verbose) printf("Invalid snapshot period: %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'T':
+                if (ParseSize(optarg, &config->threads)) 
+                {
+                    if (verbose) printf("Invalid number of threads: %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'W':
+                if (ParseSize(optarg, &config->stages)) 
+                {
+                    if (verbose) printf("Invalid number of stages: %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'K':
+                if (ParseSize(optarg, &config->chunk)) 
+                {
+                    if (verbose) printf("Invalid chunk width: %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'G':
+                if (ParseSize(optarg, &config->parareal) || config->parareal == 0) 
+                {
+                    if (verbose) printf("Invalid coarse factor: %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'O':
+                if (ParseDouble(optarg, &config->tolerance) || config->tolerance < 0) 
+                {
+                    if (verbose) printf("Invalid tolerance: %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'B':
+                if (ParseDouble(optarg, &config->plane) || !(config->plane > 0)) 
+                {
+                    if (verbose) printf("Invalid speed along y: %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'y':
+                if (ParseDouble(optarg, &config->Y) || !(config->Y > 0)) 
+                {
+                    if (verbose) printf("Invalid plane width: %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'R':
+                if (ParseSize(optarg, &config->rebalance)) 
+                {
+                    if (verbose) printf("Invalid rebalancing period: %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'C':
+                if (ParseChoice(optarg, collects, &choice)) 
+                {
+                    if (verbose) printf("Invalid collection mode: %s\n", optarg);
+                    return 1;
+                }
+                config->collect = static_cast<Collect>(choice);
+                break;
+
+            case 'F':
+                if (ParseChoice(optarg, formats, &choice)) 
+                {
+                    if (verbose) printf("Invalid output format: %s\n", optarg);
+                    return 1;
+                }
+                config->format = static_cast<Output::Format>(choice);
+                break;
+
+            case 'E':
+                if (ParseChoice(optarg, sources, &choice)) 
+                {
+                    if (verbose) printf("Invalid source evaluator: %s\n", optarg);
+                    return 1;
+                }
+                config->evaluator = static_cast<Evaluator>(choice);
+                break;
+
+            case 'r':
+                if (ParseChoice(optarg, precisions, &choice)) 
+                {
+                    if (verbose) printf("Invalid precision: %s\n", optarg);
+                    return 1;
+                }
+                config->precision = static_cast<Precision>(choice);
+                break;
+
+            case 'X':
+                if (ParseChoice(optarg, exchanges, &choice)) 
+                {
+                    if (verbose) printf("Invalid halo exchange: %s\n", optarg);
+                    return 1;
+                }
+                config->exchange = static_cast<Exchange>(choice);
+                break;
+
+            case 'L':
+                config->table = optarg;
+                break;
+
+            case 'e':
+                config->ensemble = optarg;
+                break;
+
+            case 'D':
+                if (ParseSize(optarg, &config->decimate)) 
+                {
+                    if (verbose) printf("Invalid decimation: %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'A':
+                config->analysis = optarg;
+                break;
+
+            case 'p':
+                if (config->probe_count == Config::kProbes || ParseProbe(optarg, &config->probes[config->probe_count])) 
+                {
+                    if (verbose) printf("Invalid probe: %s\n", optarg);
+                    return 1;
+                }
+                config->probe_count++;
+                break;
+
+            case 'P':
+                if (ParsePreset(optarg, &config->problem)) 
+                {
+                    if (verbose) printf("Invalid preset: %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case 'a':
+            case 'x':
+            case 't':
+            case 'd':
+            case 'u':
+                for (size_t i = 0; i < sizeof(parameters) / sizeof(parameters[0]); i++)
+                {
+                    if (parameters[i].option != option)
+                        continue;
+
+                    if (ParseDouble(optarg, &values[i]) || !(values[i] > 0))
+                    {
+                        if (verbose) printf("Invalid %s: %s\n", parameters[i].name, optarg);
+                        return 1;
+                    }
+
+                    given[i] = true;
+                }
+                break;
+
+            case 'h':
+            default:
+                if (verbose) PrintUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(parameters) / sizeof(parameters[0]); i++)
+    {
+        if (given[i]) *parameters[i].value = values[i];
+    }
+
+    /* Either axis may become the marching one, the scheme needs three layers along it */
+    if (config->problem.M() < 3 || config->problem.K() < 3)
+    {
+        if (verbose) printf("The grid is too small: M = %lu, K = %lu\n", config->problem.M(), config->problem.K());
+        return 1;
+    }
+
+    if (config->table && config->evaluator != Evaluator::Batched)
+    {
+        if (verbose) printf("The source table holds the batched values, it needs --source batched\n");
+        return 1;
+    }
+
+    if (config->stages && (config->halo || config->threads > 1))
+    {
+        if (verbose) printf("The wavefront runs one thread per rank and exchanges no deep halo\n");
+        return 1;
+    }
+
+    if (config->rebalance && (config->halo || config->stages))
+    {
+        if (verbose) printf("Rebalancing works with the one-value halo exchange only\n");
+        return 1;
+    }
+
+    if (config->exchange == Exchange::Shared && (config->halo || config->stages || config->rebalance || config->ensemble))
+    {
+        if (verbose) printf("The shared-memory exchange works with the one-value halo of Worker only\n");
+        return 1;
+    }
+
+    if (config->ensemble && (config->halo || config->stages || config->rebalance || config->threads > 1))
+    {
+        if (verbose) printf("The ensemble runs one thread per rank with the one-value halo exchange\n");
+        return 1;
+    }
+
+    if ((config->decimate > 1 || config->analysis || config->probe_count) && (config->stages || config->ensemble))
+    {
+        if (verbose) printf("Decimation and analysis work with Worker only\n");
+        return 1;
+    }
+
+    if (config->precision != Precision::Double && (config->stages || config->ensemble || config->rebalance))
+    {
+        if (verbose) printf("The reduced precision works with the equal parts of Worker only\n");
+        return 1;
+    }
+
+    if (config->decimate > 1 && config->rebalance)
+    {
+        if (verbose) printf("Decimation works with the equal parts only\n");
+        return 1;
+    }
+
+    if (config->parareal && (config->halo || config->stages || config->rebalance || config->ensemble ||
+                             config->threads > 1 || config->table || config->exchange != Exchange::Neighbor ||
+                             config->precision != Precision::Double ||
+                             config->decimate > 1 || config->analysis || config->probe_count))
+    {
+        if (verbose) printf("Parareal splits the steps, none of the options of the column split apply\n");
+        return 1;
+    }
+
+    if (config->plane && (config->halo || config->stages || config->rebalance || config->ensemble || config->parareal ||
+                          config->threads > 1 || config->table || config->exchange != Exchange::Neighbor ||
+                          config->precision != Precision::Double || config->stream ||
+                          config->decimate > 1 || config->analysis || config->probe_count))
+    {
+        if (verbose) printf("The plane keeps only its last layer and takes none of the options of the line\n");
+        return 1;
+    }
+
+    if (optind < argc)
+    {
+        config->output = argv[optind];
+    }
+
+    return 0;
+}
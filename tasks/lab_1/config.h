@@ -0,0 +1,134 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+
+#include "output.h"
+#include "equation.h"
+#include "analysis.h"
+
+enum class Collect
+{
+    Gather, // one MPI_Gather of the whole local block to rank 0
+    File,   // every rank writes its block into the output file with MPI-IO
+};
+
+enum class Exchange
+{
+    Neighbor,   // MPI_Ineighbor_alltoall over the Cartesian topology
+    Persistent, // a UserMpi::Plan of persistent sends and receives
+    Shared,     // the neighbours on the node read the edge cells from an MPI-3 shared window
+    Pscw,       // MPI_Put into the neighbours' windows, post-start-complete-wait epochs
+    Passive,    // MPI_Put into the neighbours' windows, passive target with a stamp per exchange
+};
+
+enum class Evaluator
+{
+    Batched, // the source term of a whole row with Func's SIMD f
+    Scalar,  // one libm call per cell
+};
+
+enum class Precision
+{
+    Double, // double layers and arithmetic
+    Float,  // float layers and arithmetic
+    Mixed,  // float layers, double arithmetic
+};
+
+struct Config
+{
+    /* Physical parameters and grid steps, a preset or set one by one */
+    Equation::Problem problem;
+
+    /**
+     * @brief Width of the ghost zone for the deep-halo exchange
+     * @note 0 - exchange one boundary value with each neighbour every step,
+     *       s - exchange s columns every s steps and recompute the ghost triangle locally
+     */
+    size_t halo;
+
+    /**
+     * @brief Streaming storage: keep only a ring of the last time layers
+     * @note 0 - store the whole history,
+     *       N - store a snapshot of every N-th layer
+     */
+    size_t stream;
+
+    Collect collect;
+
+    /* How Worker exchanges its halo with the neighbours */
+    Exchange exchange;
+
+    /* OpenMP threads per rank, 0 - single-threaded */
+    size_t threads;
+
+    /**
+     * @brief Space × time wavefront
+     * @note 0 - split only the columns between the ranks,
+     *       P - split the ranks into P stages that pipeline the layers over blocks of columns
+     */
+    size_t stages;
+
+    /* Columns per message of the wavefront, 0 - the default */
+    size_t chunk;
+
+    /**
+     * @brief Parareal over the marching axis
+     * @note  0 - split the columns between the ranks,
+     *        c - split the steps into one slice per rank, the coarse propagator takes c steps at once
+     */
+    size_t parareal;
+
+    /* Parareal stops once no state changes by more than this, 0 - only once they are exact */
+    double tolerance;
+
+    /**
+     * @brief The plane problem u_t + a * u_x + b * u_y = f on a 2D grid of ranks
+     * @note  0 - the line problem, b - the speed along y
+     */
+    double plane;
+
+    /* Width of the plane along y, 0 - the same as X */
+    double Y;
+
+    /**
+     * @brief Weighted decomposition
+     * @note 0 - equal parts,
+     *       N - every N steps split the columns by the measured speed of the ranks
+     */
+    size_t rebalance;
+
+    Output::Format format;
+
+    Evaluator evaluator;
+
+    /* Of the Worker layers, the reduced ones also report the error against double */
+    Precision precision;
+
+    /* File with the source term on the whole grid, built on the first run, reused by the next ones */
+    const char* table;
+
+    /* File with the cases of an ensemble, one "a [wave [decay]]" per line, see Equation::Case */
+    const char* ensemble;
+
+    const char* output;
+
+    /* Store every s-th column of the stored layers, 0 or 1 - all of them */
+    size_t decimate;
+
+    /* Extrema and norms of the stored layers reduced in situ, written here by rank 0 */
+    const char* analysis;
+
+    static constexpr size_t kProbes = 8;
+
+    /* Points (x, t) whose values are reported */
+    Analysis::Probe probes[kProbes];
+    size_t          probe_count;
+
+    /* No mode line from the solvers, for the benchmark */
+    bool quiet;
+};
+
+int ParseConfig(int argc, char* argv[], Config* config, bool verbose);
+
+#endif // CONFIG_H
@@ -0,0 +1,432 @@
+#include "ensemble.h"
+
+#include <err.h>
+#include <stdlib.h>
+#include <algorithm>
+
+Ensemble::Ensemble(int rank, int commSize, const Config& config) :
+    m_rank{rank},
+    m_commSize{commSize},
+    m_problem{config.problem},
+    m_start{0},
+    m_part{0},
+    m_M{m_problem.M()},
+    m_K{m_problem.K()},
+    m_tau{m_problem.tau},
+    m_h{m_problem.h},
+    m_inversed{0},
+    m_batched{config.evaluator == Evaluator::Batched},
+    m_quiet{config.quiet},
+    m_scheme{},
+    m_kernels{nullptr},
+    m_ensemble{nullptr},
+    m_cases{},
+    m_a{},
+    m_E{0},
+    m_every{config.stream ? config.stream : 1},
+    m_rows{0},
+    m_collect{config.collect},
+    m_data{},
+    m_frow{},
+    m_plans{},
+    m_history{},
+    m_result{},
+    m_table{},
+    m_stats{}
+{}
+
+int Ensemble::ReadCases(const char* path, std::vector<Equation::Case>* cases)
+{
+    FILE* file = fopen(path, "r");
+    if (!file) return 1;
+
+    char line[256] = "";
+
+    while (fgets(line, sizeof(line), file))
+    {
+        Equation::Case c{0, 1, 1};
+
+        int count = sscanf(line, "%lf %lf %lf", &c.a, &c.wave, &c.decay);
+
+        if (count <= 0) continue;
+
+        if (!(c.a > 0))
+        {
+            fclose(file);
+            return 1;
+        }
+
+        cases->push_back(c);
+    }
+
+    fclose(file);
+
+    return cases->empty();
+}
+
+int Ensemble::Init(UserMpi::MPI* master, const char* path)
+{
+    if (ReadCases(path, &m_cases))
+    {
+        if (m_rank == 0)
+        {
+            warnx("Ensemble: no valid cases \"a [wave [decay]]\" in %s", path);
+        }
+
+        return 1;
+    }
+
+    m_E = m_cases.size();
+
+    /* The mode of every member, they all have to march along the same axis */
+    size_t inversed = 0;
+
+    for (const Equation::Case& c : m_cases)
+    {
+        inversed += !(c.a * m_tau / m_h < 1);
+    }
+
+    if (inversed != 0 && inversed != m_E)
+    {
+        if (m_rank == 0)
+        {
+            warnx("Ensemble: %lu of %lu cases have a * tau / h >= 1, the modes must not mix", inversed, m_E);
+        }
+
+        return 1;
+    }
+
+    m_inversed = (inversed != 0);
+
+    if (m_rank == 0 && !m_quiet)
+    {
+        printf("Mode: %s\nInversed: %s\nEnsemble: %lu cases\n",
+               ((m_M < m_K) != m_inversed) ? "slow" : "fast", m_inversed ? "true" : "false", m_E);
+    }
+
+    if (m_inversed)
+    {
+        std::swap(m_M, m_K);
+        std::swap(m_h, m_tau);
+    }
+
+    m_M     = (m_M / m_commSize + !!(m_M % m_commSize)) * m_commSize;
+    m_part  =  m_M / m_commSize;
+    m_start =  m_part * m_rank;
+
+    if (m_part < 2)
+    {
+        if (m_rank == 0)
+        {
+            warnx("Ensemble: %lu columns do not split into %d parts at least two columns wide", m_M, m_commSize);
+        }
+
+        return 1;
+    }
+
+    m_scheme   = {0, m_tau, m_h, static_cast<ptrdiff_t>(m_start), {m_problem.X, m_problem.T}};
+    m_kernels  = &SelectKernels(m_inversed, m_batched);
+    m_ensemble = &SelectEnsembleKernels(m_inversed);
+
+    for (const Equation::Case& c : m_cases)
+    {
+        m_a.push_back(c.a);
+    }
+
+    m_rows = (m_K - 1) / m_every + 1;
+
+    m_data.assign(3 * (m_part + 2) * m_E, 0);
+    m_frow.assign(m_part, 0);
+    m_history.assign(m_rows * m_part * m_E, 0);
+
+    if (m_rank == 0 && m_collect == Collect::Gather)
+    {
+        m_result.assign(m_rows * m_M * m_E, 0);
+    }
+
+    /* Own edge cells out, the ghost cells in, all E members in one message */
+    for (size_t slot = 0; slot < 3; slot++)
+    {
+        double* row = Row(slot);
+
+        if (m_rank != 0)
+        {
+            m_plans[slot].send(master, row, m_E, MPI::DOUBLE, m_rank - 1, 0, MPI_COMM_WORLD);
+            if (master->check()) return 1;
+
+            m_plans[slot].recv(master, row - m_E, m_E, MPI::DOUBLE, m_rank - 1, MPI_ANY_TAG, MPI_COMM_WORLD);
+            if (master->check()) return 1;
+        }
+
+        if (m_rank != m_commSize - 1)
+        {
+            m_plans[slot].send(master, row + (m_part - 1) * m_E, m_E, MPI::DOUBLE, m_rank + 1, 0, MPI_COMM_WORLD);
+            if (master->check()) return 1;
+
+            m_plans[slot].recv(master, row + m_part * m_E, m_E, MPI::DOUBLE, m_rank + 1, MPI_ANY_TAG, MPI_COMM_WORLD);
+            if (master->check()) return 1;
+        }
+    }
+
+    return 0;
+}
+
+int Ensemble::OpenSourceTable(UserMpi::MPI* master, const char* path)
+{
+    return m_table.Open(master, MPI_COMM_WORLD, path, GetHeader(1), m_scheme, *m_kernels);
+}
+
+void Ensemble::FillBoundary(size_t k)
+{
+    if (m_rank == 0)
+    {
+        for (size_t e = 0; e < m_E; e++)
+        {
+            Row(k)[e] = m_ensemble->boundary(m_scheme, m_cases[e], k);
+        }
+    }
+}
+
+void Ensemble::FillSource(size_t k)
+{
+    size_t split = 0;
+
+    if (m_table.IsOpen())
+    {
+        /* The padding columns are not in the table */
+        split = std::min(m_part, (m_table.Cols() > m_start) ? m_table.Cols() - m_start : 0);
+
+        memcpy(m_frow.data(), m_table.Row(k) + m_start, split * sizeof(double));
+    }
+
+    m_kernels->sourceRow(m_scheme, k, split, m_part, m_frow.data());
+}
+
+void Ensemble::Store(size_t k)
+{
+    if (k % m_every == 0)
+    {
+        memcpy(m_history.data() + (k / m_every) * m_part * m_E, Row(k), m_part * m_E * sizeof(double));
+    }
+}
+
+int Ensemble::FillInitialConditions()
+{
+    for (size_t i = 0; i < m_part; i++)
+    {
+        for (size_t e = 0; e < m_E; e++)
+        {
+            Row(0)[i * m_E + e] = m_ensemble->initial(m_scheme, m_cases[e], m_start + i);
+        }
+    }
+
+    Store(0);
+
+    return 0;
+}
+
+int Ensemble::FillFirstLine(UserMpi::MPI* master)
+{
+    /* The left neighbour of both layers goes to the ghost cells */
+    if (m_rank != 0)
+    {
+        master->recv(Row(1) - m_E, m_E, MPI::DOUBLE, m_rank - 1, MPI_ANY_TAG, MPI_COMM_WORLD);
+        if (master->check()) return 1;
+
+        master->recv(Row(0) - m_E, m_E, MPI::DOUBLE, m_rank - 1, MPI_ANY_TAG, MPI_COMM_WORLD);
+        if (master->check()) return 1;
+    }
+
+    FillBoundary(1);
+
+    m_ensemble->firstLine(m_scheme, m_a.data(), m_E, (m_rank == 0) ? 1 : 0, m_part, Row(0), Row(1));
+
+    if (m_rank != m_commSize - 1)
+    {
+        master->send(Row(1) + (m_part - 1) * m_E, m_E, MPI::DOUBLE, m_rank + 1, 0, MPI_COMM_WORLD);
+        if (master->check()) return 1;
+
+        master->send(Row(0) + (m_part - 1) * m_E, m_E, MPI::DOUBLE, m_rank + 1, 0, MPI_COMM_WORLD);
+        if (master->check()) return 1;
+    }
+
+    Store(1);
+
+    return 0;
+}
+
+int Ensemble::FillOtherLines(UserMpi::MPI* master)
+{
+    bool left  = (m_rank != 0);
+    bool right = (m_rank != m_commSize - 1);
+
+    for (size_t k = 1; k < m_K - 1; k++)
+    {
+        UserMpi::Plan& plan = m_plans[k % 3];
+
+        if (plan.size())
+        {
+            plan.start(master);
+            if (master->check()) return 1;
+
+            m_stats.messages += plan.size() / 2;
+            m_stats.bytes    += plan.size() / 2 * m_E * sizeof(double);
+        }
+
+        FillBoundary(k + 1);
+        FillSource(k);
+
+        m_ensemble->update(m_scheme, m_a.data(), m_E, 1, m_part - 1, Row(k - 1), Row(k), Row(k + 1), m_frow.data());
+
+        if (plan.size())
+        {
+            plan.wait(master);
+            if (master->check()) return 1;
+        }
+
+        if (left)
+        {
+            m_ensemble->update(m_scheme, m_a.data(), m_E, 0, 1, Row(k - 1), Row(k), Row(k + 1), m_frow.data());
+        }
+
+        if (right)
+        {
+            m_ensemble->update(m_scheme, m_a.data(), m_E, m_part - 1, m_part, Row(k - 1), Row(k), Row(k + 1), m_frow.data());
+        }
+        else
+        {
+            m_ensemble->edge(m_scheme, m_a.data(), m_E, k, m_part - 1, Row(k), Row(k + 1));
+        }
+
+        Store(k + 1);
+    }
+
+    return 0;
+}
+
+Output::Header Ensemble::GetHeader(size_t every) const
+{
+    /* Stored rows follow the marching axis, which is x in the inversed mode */
+    size_t rows = (m_K - 1) / every + 1;
+    size_t cols = m_inversed ? m_problem.K() : m_problem.M();
+
+    return Output::MakeHeader(m_inversed ? Output::Layout::XT : Output::Layout::TX, m_inversed,
+                              m_problem.X, m_problem.T,
+                              m_inversed ? m_tau * every : m_h,
+                              m_inversed ? m_h : m_tau * every,
+                              m_inversed ? rows : cols,
+                              m_inversed ? cols : rows);
+}
+
+std::string Ensemble::MemberPath(const char* path, size_t e)
+{
+    return std::string(path) + "." + std::to_string(e);
+}
+
+void Ensemble::Extract(const double* rows, size_t count, size_t cols, size_t stride, size_t e, double* member) const
+{
+    for (size_t row = 0; row < count; row++)
+    {
+        for (size_t m = 0; m < cols; m++)
+        {
+            member[row * cols + m] = rows[(row * stride + m) * m_E + e];
+        }
+    }
+}
+
+int Ensemble::Dump(const char* path, Output::Format format)
+{
+    Output::Header header = GetHeader(m_every);
+
+    size_t cols = m_inversed ? header.K : header.M;
+
+    std::vector<double> member(m_rows * cols);
+
+    for (size_t e = 0; e < m_E; e++)
+    {
+        Extract(m_result.data(), m_rows, cols, m_M, e, member.data());
+
+        FILE* file = fopen(MemberPath(path, e).c_str(), "w");
+        if (!file) return 1;
+
+        int status = Output::Dump(file, format, header, {0, 0, m_rows, cols, cols, member.data()});
+
+        fclose(file);
+
+        if (status) return 1;
+    }
+
+    return 0;
+}
+
+int Ensemble::Gather(UserMpi::MPI* master)
+{
+    if (m_collect != Collect::Gather)
+    {
+        return 0;
+    }
+
+    MPI_Datatype column = MPI_DATATYPE_NULL;
+    MPI_Datatype stripe = MPI_DATATYPE_NULL;
+
+    /* The own rows placed into the global field, rank i starts at cell i * m_part */
+    master->typeVector(m_rows, m_part * m_E, m_M * m_E, MPI::DOUBLE, &column);
+    if (master->check()) return 1;
+
+    master->typeResized(column, 0, m_part * m_E * sizeof(double), &stripe);
+    if (master->check()) return 1;
+
+    master->typeCommit(&stripe);
+    if (master->check()) return 1;
+
+    master->gather(m_history.data(), m_rows * m_part * m_E, MPI::DOUBLE, m_result.data(), 1, stripe, 0, MPI_COMM_WORLD);
+    if (master->check()) return 1;
+
+    master->typeFree(&stripe);
+    master->typeFree(&column);
+
+    return master->check();
+}
+
+int Ensemble::Write(UserMpi::MPI* master, const char* path, Output::Format format)
+{
+    Output::Header header = GetHeader(m_every);
+
+    size_t cols  = m_inversed ? header.K : header.M;
+    size_t local = (m_start < cols) ? std::min(m_part, cols - m_start) : 0;
+
+    std::vector<double> member(m_rows * local);
+
+    for (size_t e = 0; e < m_E; e++)
+    {
+        std::vector<Output::Block> blocks;
+
+        if (local)
+        {
+            Extract(m_history.data(), m_rows, local, m_part, e, member.data());
+
+            blocks.push_back({0, m_start, m_rows, local, local, member.data()});
+        }
+
+        if (Output::Write(master, MPI_COMM_WORLD, MemberPath(path, e).c_str(), format, header, blocks)) return 1;
+    }
+
+    return 0;
+}
+
+int Ensemble::Report(UserMpi::MPI* master)
+{
+    unsigned long long local[2] = {m_stats.messages, m_stats.bytes};
+    unsigned long long total[2] = {};
+
+    master->reduce(local, total, 2, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (master->check()) return 1;
+
+    if (m_rank == 0 && m_commSize > 1)
+    {
+        printf("Messages: %llu\n", total[0]);
+        printf("Bytes: %llu\n",    total[1]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,124 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <string>
+#include <vector>
+#include <memory.h>
+
+#include "user_mpi.h"
+#include "equation.h"
+#include "kernel.h"
+#include "config.h"
+#include "output.h"
+#include "source_table.h"
+
+/**
+ * @brief E cases of the problem on one grid at once: the columns are split between the ranks
+ *        as in Worker, every cell holds the values of all E members next to each other
+ * @note  The members share the source term and the grid, so one row of f serves all of them,
+ *        the stencil is vectorised across the members and every halo message carries
+ *        the E values of the edge cell. All members must be in the same mode (a * tau / h < 1
+ *        or not), so they march along the same axis.
+ */
+class Ensemble
+{
+public:
+    explicit Ensemble(int rank, int commSize, const Config& config);
+
+    Ensemble(const Ensemble& ensemble) = delete;
+
+    /* Reads the cases and allocates the layers, every rank reads the same file */
+    int Init(UserMpi::MPI* master, const char* path);
+
+    int OpenSourceTable(UserMpi::MPI* master, const char* path);
+
+    int FillInitialConditions();
+
+    int FillFirstLine(UserMpi::MPI* master);
+
+    int FillOtherLines(UserMpi::MPI* master);
+
+    /* Member e goes to <path>.e */
+    int Dump(const char* path, Output::Format format);
+
+    int Gather(UserMpi::MPI* master);
+
+    int Write(UserMpi::MPI* master, const char* path, Output::Format format);
+
+    int Report(UserMpi::MPI* master);
+
+private:
+    struct Stats
+    {
+        unsigned long long messages;
+        unsigned long long bytes;
+    };
+
+    static int ReadCases(const char* path, std::vector<Equation::Case>* cases);
+
+    static std::string MemberPath(const char* path, size_t e);
+
+    Output::Header GetHeader(size_t every) const;
+
+    void FillBoundary(size_t k);
+
+    void FillSource(size_t k);
+
+    void Store(size_t k);
+
+    /* The member e of the stored rows as a field of its own */
+    void Extract(const double* rows, size_t count, size_t cols, size_t stride, size_t e, double* member) const;
+
+    /* Cell m of the layer k, the E members start here, the cells -1 and m_part are the ghosts */
+    inline double* Row(size_t k)
+    {
+        return m_data.data() + ((k % 3) * (m_part + 2) + 1) * m_E;
+    }
+
+    int m_rank;
+    int m_commSize;
+
+    Equation::Problem m_problem;
+
+    size_t m_start;
+    size_t m_part;
+
+    size_t m_M;
+    size_t m_K;
+
+    double m_tau;
+    double m_h;
+
+    int  m_inversed;
+    bool m_batched;
+    bool m_quiet;
+
+    Scheme m_scheme;
+    const Kernels*         m_kernels;
+    const EnsembleKernels* m_ensemble;
+
+    std::vector<Equation::Case> m_cases;
+    std::vector<double>         m_a; // the speeds of the members in one array for the simd loops
+    size_t m_E;
+
+    size_t m_every;
+    size_t m_rows;
+
+    Collect m_collect;
+
+    std::vector<double> m_data; // three layers of (m_part + 2) cells of m_E members
+    std::vector<double> m_frow; // source term of the layer being computed
+
+    /* The layer k is exchanged from its own ring slot, so every slot has its own plan */
+    UserMpi::Plan m_plans[3];
+
+    std::vector<double> m_history; // the stored rows of the own cells
+    std::vector<double> m_result;  // rank 0: the rows of all cells
+
+    SourceTable m_table;
+
+    Stats m_stats;
+
+}; // class Ensemble
+
+#endif // ENSEMBLE_H
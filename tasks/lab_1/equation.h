@@ -2,6 +2,10 @@
 #define EQUATION_H
 
 #include <cmath>
+#include <algorithm>
+#include <stddef.h>
+
+#include "simd_math.h"
 
 namespace Equation 
 {
@@ -12,61 +16,158 @@ namespace Equation
  *        where C - Courant number
  * @note C = 1 for the cross method
  */
+struct Problem
+{
+    double a;
+    double X;
+    double T;
 
-// /*NOTE - For fast/true mode */
-// static constexpr double a = 1.0;
-// static constexpr double X = 1.0;
-// static constexpr double T = 1000.0;
-
-// static constexpr double h = 0.001;
-// static constexpr double tau = 0.01;
-
-// /*NOTE - For slow/true mode */
-// static constexpr double a = 1.0;
-// static constexpr double X = 100.0;
-// static constexpr double T = 10.0;
-
-// static constexpr double h = 0.001;
-// static constexpr double tau = 0.01;
-
+    double h;
+    double tau;
 
-// /*NOTE - For fast/false mode */
-// static constexpr double a = 1.0;
-// static constexpr double X = 500.0;
-// static constexpr double T = 1.0;
+    size_t M() const
+    {
+        return X / h;
+    }
 
-// static constexpr double h = 0.005;
-// static constexpr double tau = 0.001;
+    size_t K() const
+    {
+        return T / tau;
+    }
+};
 
-/*NOTE - For slow/false mode */
-static constexpr double a = 1.0;
-static constexpr double X = 5.0;
-static constexpr double T = 100.0;
+struct Preset
+{
+    const char* name;
+    Problem problem;
+};
 
-static constexpr double h = 0.005;
-static constexpr double tau = 0.001;
+static constexpr Preset presets[] =
+{
+    {"fast-inversed", {1.0, 1.0,   1000.0, 0.001, 0.01 }},
+    {"slow-inversed", {1.0, 100.0, 10.0,   0.001, 0.01 }},
+    {"fast",          {1.0, 500.0, 1.0,    0.005, 0.001}},
+    {"slow",          {1.0, 5.0,   100.0,  0.005, 0.001}},
+};
 
-static constexpr size_t K = T / tau;
-static constexpr size_t M = X / h;
+static constexpr Problem problem = presets[3].problem;
 
 struct Func
 {
-    static double f(double x, double t)
+    double X;
+    double T;
+
+    double f(double x, double t) const
     { 
         return std::exp(std::sin(x * t / X / T));
     }
 
-    static double phi(double x)
+    /**
+     * @brief f(x[i], t) for count points of one row, four at a time with SimdMath
+     * @note  Within 2 ulp of the scalar f. Every value depends only on its own x, so the result
+     *        does not depend on how the row is split. In and out may be the same array.
+     */
+    void f(const double* x, double t, double* out, size_t count) const
+    {
+        const __m256d tv     = _mm256_set1_pd(t);
+        const __m256d Xv     = _mm256_set1_pd(X);
+        const __m256d Tv     = _mm256_set1_pd(T);
+        const __m256d limit  = _mm256_set1_pd(SimdMath::SinLimit);
+        const __m256d nosign = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffll));
+
+        for (size_t i = 0; i < count; i += 4)
+        {
+            /* The tail goes through the same path, padded with zeros */
+            size_t n = std::min<size_t>(4, count - i);
+
+            double lanes[4] = {};
+
+            if (n < 4) std::copy(x + i, x + i + n, lanes);
+
+            __m256d arg = _mm256_loadu_pd(n < 4 ? lanes : x + i);
+
+            arg = _mm256_div_pd(_mm256_div_pd(_mm256_mul_pd(arg, tv), Xv), Tv);
+
+            __m256d far    = _mm256_cmp_pd(_mm256_and_pd(arg, nosign), limit, _CMP_GT_OQ);
+            __m256d result = SimdMath::Exp(SimdMath::Sin(arg));
+
+            /* Out of the reduction range, rare enough to go back to libm */
+            if (n == 4 && !_mm256_movemask_pd(far))
+            {
+                _mm256_storeu_pd(out + i, result);
+                continue;
+            }
+
+            _mm256_storeu_pd(lanes, result);
+
+            for (size_t j = 0; j < n; j++)
+            {
+                out[i + j] = (std::fabs(x[i + j] * t / X / T) > SimdMath::SinLimit) ? f(x[i + j], t) : lanes[j];
+            }
+        }
+    }
+
+    double phi(double x) const
     {
         return std::cos(M_PI * x / X);
     }
 
-    static double psi(double t)
+    double psi(double t) const
     {
         return std::exp(-t / T);
     }
 };
 
+/**
+ * @brief The plane problem u_t + a * u_x + b * u_y = f(x, y, t) on [0, X] x [0, Y]
+ * @note  f(x, y, t) is Func's f of x + y on the length X + Y, so a row of it goes through
+ *        the batched f. psi holds on the inflow edges x = 0 and y = 0.
+ */
+struct PlaneFunc
+{
+    double X;
+    double Y;
+    double T;
+
+    Func line() const
+    {
+        return {X + Y, T};
+    }
+
+    double f(double x, double y, double t) const
+    {
+        return line().f(x + y, t);
+    }
+
+    double phi(double x, double y) const
+    {
+        return std::cos(M_PI * x / X) * std::cos(M_PI * y / Y);
+    }
+
+    double psi(double x, double y, double t) const
+    {
+        return std::exp(-t / T) * phi(x, y);
+    }
+};
+
+/* One member of an ensemble: its own speed and shapes of phi and psi, (a, 1, 1) is Func's problem */
+struct Case
+{
+    double a;
+    double wave;  // phi(x) = cos(pi * wave * x / X)
+    double decay; // psi(t) = exp(-decay * t / T)
+
+    double phi(const Func& func, double x) const
+    {
+        return std::cos(M_PI * wave * x / func.X);
+    }
+
+    double psi(const Func& func, double t) const
+    {
+        return std::exp(-decay * t / func.T);
+    }
+};
+
 }; // namespace Equation
 
 #endif // EQUATION_H
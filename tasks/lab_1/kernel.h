@@ -0,0 +1,400 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <stddef.h>
+
+#include "equation.h"
+
+/**
+ * @brief Constants of one run in the marching coordinates: the scheme marches along k
+ *        with the step tau and sweeps along m with the step h, x and t swap in the inversed mode
+ */
+struct Scheme
+{
+    double a;
+    double tau;
+    double h;
+
+    ptrdiff_t start; // global index of the first local column
+
+    Equation::Func func;
+};
+
+/**
+ * @brief The scheme with the mode resolved at compile time, so the loops over a layer
+ *        have no branches left
+ */
+template <bool Inversed>
+struct Kernel
+{
+    /* Source term at the marching coordinate k and the global column m */
+    static inline double Source(const Scheme& s, double k, double m)
+    {
+        if constexpr (Inversed) return s.func.f(k * s.tau, m * s.h);
+        else                    return s.func.f(m * s.h, k * s.tau);
+    }
+
+    /* The layer k = 0 */
+    static inline double Initial(const Scheme& s, double m)
+    {
+        if constexpr (Inversed) return s.func.psi(s.h * m);
+        else                    return s.func.phi(s.h * m);
+    }
+
+    /* The column m = 0 */
+    static inline double Boundary(const Scheme& s, double k)
+    {
+        if constexpr (Inversed) return s.func.phi(s.tau * k);
+        else                    return s.func.psi(s.tau * k);
+    }
+
+    /**
+     * @brief The cross scheme: u[k + 1][m] from u[k - 1][m], u[k][m - 1] and u[k][m + 1]
+     *        with the speed a (of one ensemble member), computed in the precision C
+     */
+    template <typename C>
+    static inline C Cross(const Scheme& s, C a, C prev, C left, C right, C f)
+    {
+        const C tau = s.tau;
+        const C h   = s.h;
+
+        C first_part  = (- prev       ) / (2 * tau);
+        C second_part = (  right - left) / (2 * h);
+
+        if constexpr (Inversed) return (f - a * first_part -     second_part) * 2 * tau / a;
+        else                    return (f -     first_part - a * second_part) * 2 * tau;
+    }
+
+    /* The cross scheme on the stored values of the precision T, computed in the precision C */
+    template <typename T, typename C>
+    static inline T CrossCell(const Scheme& s, T prev, T left, T right, double f)
+    {
+        return Cross<C>(s, s.a, prev, left, right, f);
+    }
+
+    /* The corner scheme: u[k + 1][m] from u[k + 1][m - 1] (up), u[k][m - 1] (down) and u[k][m] */
+    template <typename C>
+    static inline C Corner(const Scheme& s, C a, C up, C down, C curr, C f)
+    {
+        const C tau = s.tau;
+        const C h   = s.h;
+
+        C first_part  = ( up - down - curr) / (2 * tau);
+        C second_part = (-up - down + curr) / (2 * h);
+
+        if constexpr (Inversed) return (f - a * first_part -     second_part) * 2 / (a / tau +   1 / h);
+        else                    return (f -     first_part - a * second_part) * 2 / (1 / tau + a / h);
+    }
+
+    template <typename T, typename C>
+    static inline T CornerCell(const Scheme& s, T up, T down, T curr, double f)
+    {
+        return Corner<C>(s, s.a, up, down, curr, f);
+    }
+
+    /* Source term of the cells [begin, end) of the layer k, one call per cell */
+    static void SourceRow(const Scheme& s, size_t k, ptrdiff_t begin, ptrdiff_t end, double* f)
+    {
+        for (ptrdiff_t m = begin; m < end; m++) 
+        {
+            f[m] = Source(s, k, s.start + m);
+        }
+    }
+
+    /* The same with Func's batched f: x * t is the same product in both modes */
+    static void SourceRowBatched(const Scheme& s, size_t k, ptrdiff_t begin, ptrdiff_t end, double* f)
+    {
+        if (begin >= end) return;
+
+        for (ptrdiff_t m = begin; m < end; m++) 
+        {
+            f[m] = (s.start + m) * s.h;
+        }
+
+        s.func.f(f + begin, k * s.tau, f + begin, end - begin);
+    }
+
+    /**
+     * @brief Interior cells [begin, end) of the layer k + 1 with the source term already in f
+     * @note  The layers are stored as T and computed as C, so float storage with double
+     *        arithmetic halves the memory traffic and keeps the rounding of every step small
+     */
+    template <typename T, typename C>
+    static void Update(const Scheme& s, ptrdiff_t begin, ptrdiff_t end,
+                       const T* prev, const T* curr, T* next, const double* f)
+    {
+        const C a = s.a;
+
+        #pragma omp simd
+        for (ptrdiff_t m = begin; m < end; m++) 
+        {
+            next[m] = Cross<C>(s, a, prev[m], curr[m - 1], curr[m + 1], f[m]);
+        }
+    }
+
+    /* The right boundary cell m of the layer k + 1 */
+    template <typename T, typename C>
+    static T Edge(const Scheme& s, size_t k, ptrdiff_t m, const T* curr, const T* next)
+    {
+        return Corner<C>(s, s.a, next[m - 1], curr[m - 1], curr[m], Source(s, k + 0.5, s.start + m + 0.5));
+    }
+
+    /* The first layer is swept with the corner scheme, (up, down) is the left neighbour of begin */
+    template <typename T, typename C>
+    static void FirstLine(const Scheme& s, ptrdiff_t begin, ptrdiff_t end,
+                          const T* curr, T* next, T up, T down)
+    {
+        for (ptrdiff_t m = begin; m < end; m++) 
+        {
+            next[m] = Corner<C>(s, s.a, up, down, curr[m], Source(s, 1 + 0.5, s.start + m + 0.5));
+
+            up   = next[m];
+            down = curr[m];
+        }
+    }
+
+    /**
+     * @brief The ensemble: cell m of the layer holds the E members at [m * E, (m + 1) * E),
+     *        member e has the speed a[e] and the case cases[e], the source term is shared
+     */
+    static inline double Initial(const Scheme& s, const Equation::Case& c, double m)
+    {
+        if constexpr (Inversed) return c.psi(s.func, s.h * m);
+        else                    return c.phi(s.func, s.h * m);
+    }
+
+    static inline double Boundary(const Scheme& s, const Equation::Case& c, double k)
+    {
+        if constexpr (Inversed) return c.phi(s.func, s.tau * k);
+        else                    return c.psi(s.func, s.tau * k);
+    }
+
+    /* Cells [begin, end) of the layer k + 1, the members of a cell are one simd loop */
+    static void UpdateEnsemble(const Scheme& s, const double* a, size_t E, ptrdiff_t begin, ptrdiff_t end,
+                               const double* prev, const double* curr, double* next, const double* f)
+    {
+        for (ptrdiff_t m = begin; m < end; m++) 
+        {
+            const double* p = prev + m * E;
+            const double* l = curr + (m - 1) * E;
+            const double* r = curr + (m + 1) * E;
+            double*       n = next + m * E;
+
+            #pragma omp simd
+            for (size_t e = 0; e < E; e++)
+            {
+                n[e] = Cross(s, a[e], p[e], l[e], r[e], f[m]);
+            }
+        }
+    }
+
+    static void EdgeEnsemble(const Scheme& s, const double* a, size_t E, size_t k, ptrdiff_t m,
+                             const double* curr, double* next)
+    {
+        double f = Source(s, k + 0.5, s.start + m + 0.5);
+
+        #pragma omp simd
+        for (size_t e = 0; e < E; e++)
+        {
+            next[m * E + e] = Corner(s, a[e], next[(m - 1) * E + e], curr[(m - 1) * E + e], curr[m * E + e], f);
+        }
+    }
+
+    /* The cell begin - 1 of both layers holds the left neighbour */
+    static void FirstLineEnsemble(const Scheme& s, const double* a, size_t E, ptrdiff_t begin, ptrdiff_t end,
+                                  const double* curr, double* next)
+    {
+        for (ptrdiff_t m = begin; m < end; m++) 
+        {
+            double f = Source(s, 1 + 0.5, s.start + m + 0.5);
+
+            #pragma omp simd
+            for (size_t e = 0; e < E; e++)
+            {
+                next[m * E + e] = Corner(s, a[e], next[(m - 1) * E + e], curr[(m - 1) * E + e], curr[m * E + e], f);
+            }
+        }
+    }
+};
+
+/**
+ * @brief Kernels of one mode and source evaluator, picked once per run
+ * @note  The layers are stored as T and computed as C, the source term is always double
+ */
+template <typename T, typename C>
+struct BasicKernels
+{
+    double (*source)  (const Scheme&, double, double);
+    double (*initial) (const Scheme&, double);
+    double (*boundary)(const Scheme&, double);
+    T      (*cross)   (const Scheme&, T, T, T, double);
+    T      (*corner)  (const Scheme&, T, T, T, double);
+
+    void (*sourceRow)(const Scheme&, size_t, ptrdiff_t, ptrdiff_t, double*);
+    void (*update)   (const Scheme&, ptrdiff_t, ptrdiff_t, const T*, const T*, T*, const double*);
+    T    (*edge)     (const Scheme&, size_t, ptrdiff_t, const T*, const T*);
+    void (*firstLine)(const Scheme&, ptrdiff_t, ptrdiff_t, const T*, T*, T, T);
+};
+
+using Kernels = BasicKernels<double, double>;
+
+template <typename T, typename C, bool Inversed, bool Batched>
+static constexpr BasicKernels<T, C> MakeKernels()
+{
+    return {Kernel<Inversed>::Source,   Kernel<Inversed>::Initial,  Kernel<Inversed>::Boundary,
+            Kernel<Inversed>::template CrossCell<T, C>, Kernel<Inversed>::template CornerCell<T, C>,
+            Batched ? Kernel<Inversed>::SourceRowBatched : Kernel<Inversed>::SourceRow,
+            Kernel<Inversed>::template Update<T, C>,
+            Kernel<Inversed>::template Edge<T, C>,
+            Kernel<Inversed>::template FirstLine<T, C>};
+}
+
+/* The corner cells and the first line sit between the grid nodes and always use the scalar f */
+template <typename T = double, typename C = T>
+static inline const BasicKernels<T, C>& SelectKernels(bool inversed, bool batched)
+{
+    static constexpr BasicKernels<T, C> kernels[2][2] = 
+    {
+        {MakeKernels<T, C, false, false>(), MakeKernels<T, C, false, true>()},
+        {MakeKernels<T, C, true,  false>(), MakeKernels<T, C, true,  true>()},
+    };
+
+    return kernels[inversed][batched];
+}
+
+/* Kernels of the ensemble of one mode, the source term of a row comes from Kernels */
+struct EnsembleKernels
+{
+    double (*initial) (const Scheme&, const Equation::Case&, double);
+    double (*boundary)(const Scheme&, const Equation::Case&, double);
+
+    void (*update)   (const Scheme&, const double*, size_t, ptrdiff_t, ptrdiff_t, const double*, const double*, double*, const double*);
+    void (*edge)     (const Scheme&, const double*, size_t, size_t, ptrdiff_t, const double*, double*);
+    void (*firstLine)(const Scheme&, const double*, size_t, ptrdiff_t, ptrdiff_t, const double*, double*);
+};
+
+template <bool Inversed>
+static constexpr EnsembleKernels MakeEnsembleKernels()
+{
+    return {Kernel<Inversed>::Initial,        Kernel<Inversed>::Boundary,
+            Kernel<Inversed>::UpdateEnsemble, Kernel<Inversed>::EdgeEnsemble, Kernel<Inversed>::FirstLineEnsemble};
+}
+
+static inline const EnsembleKernels& SelectEnsembleKernels(bool inversed)
+{
+    static constexpr EnsembleKernels kernels[2] = {MakeEnsembleKernels<false>(), MakeEnsembleKernels<true>()};
+
+    return kernels[inversed];
+}
+
+/**
+ * @brief Constants of the plane problem: the layers go along t with the step tau, a layer is
+ *        stored by columns of constant x, both x and y have the step h
+ */
+struct PlaneScheme
+{
+    double a;
+    double b;
+    double tau;
+    double h;
+
+    ptrdiff_t x0; // global indices of the first local cell
+    ptrdiff_t y0;
+
+    Equation::PlaneFunc func;
+};
+
+/* The plane kernels on the local column i, its cells j go along y */
+template <bool Batched>
+struct PlaneKernel
+{
+    static inline double Initial(const PlaneScheme& s, ptrdiff_t i, ptrdiff_t j)
+    {
+        return s.func.phi((s.x0 + i) * s.h, (s.y0 + j) * s.h);
+    }
+
+    /* The inflow edges x = 0 and y = 0 of the layer k */
+    static inline double Boundary(const PlaneScheme& s, size_t k, ptrdiff_t i, ptrdiff_t j)
+    {
+        return s.func.psi((s.x0 + i) * s.h, (s.y0 + j) * s.h, k * s.tau);
+    }
+
+    /* Source term of the cells [begin, end) of the column i of the layer k, the same value for every split */
+    static void SourceLine(const PlaneScheme& s, size_t k, ptrdiff_t i, ptrdiff_t begin, ptrdiff_t end, double* f)
+    {
+        if (begin >= end) return;
+
+        if constexpr (Batched)
+        {
+            for (ptrdiff_t j = begin; j < end; j++)
+            {
+                f[j] = (s.x0 + i) * s.h + (s.y0 + j) * s.h;
+            }
+
+            s.func.line().f(f + begin, k * s.tau, f + begin, end - begin);
+        }
+        else
+        {
+            for (ptrdiff_t j = begin; j < end; j++)
+            {
+                f[j] = s.func.f((s.x0 + i) * s.h, (s.y0 + j) * s.h, k * s.tau);
+            }
+        }
+    }
+
+    /* The cross scheme: u[k + 1] from u[k - 1] and the four neighbours of the cell in u[k] */
+    static inline double Cross(const PlaneScheme& s, double prev, double left, double right, double down, double up, double f)
+    {
+        double x_part = s.a * (right - left) / (2 * s.h);
+        double y_part = s.b * (up    - down) / (2 * s.h);
+
+        return (f - x_part - y_part) * 2 * s.tau + prev;
+    }
+
+    /* The upwind scheme of the first layer and the outflow edges: u[k + 1] from the cell and its inflow neighbours */
+    static inline double Upwind(const PlaneScheme& s, double curr, double left, double down, double f)
+    {
+        double x_part = s.a * (curr - left) / s.h;
+        double y_part = s.b * (curr - down) / s.h;
+
+        return (f - x_part - y_part) * s.tau + curr;
+    }
+
+    /* Cells [begin, end) of the column i of the layer k + 1, left and right are the columns i - 1 and i + 1 of u[k] */
+    static void Update(const PlaneScheme& s, ptrdiff_t begin, ptrdiff_t end, const double* prev, const double* curr,
+                       const double* left, const double* right, double* next, const double* f)
+    {
+        #pragma omp simd
+        for (ptrdiff_t j = begin; j < end; j++)
+        {
+            next[j] = Cross(s, prev[j], left[j], right[j], curr[j - 1], curr[j + 1], f[j]);
+        }
+    }
+};
+
+struct PlaneKernels
+{
+    double (*initial)   (const PlaneScheme&, ptrdiff_t, ptrdiff_t);
+    double (*boundary)  (const PlaneScheme&, size_t, ptrdiff_t, ptrdiff_t);
+    void   (*sourceLine)(const PlaneScheme&, size_t, ptrdiff_t, ptrdiff_t, ptrdiff_t, double*);
+    double (*cross)     (const PlaneScheme&, double, double, double, double, double, double);
+    double (*upwind)    (const PlaneScheme&, double, double, double, double);
+
+    void (*update)(const PlaneScheme&, ptrdiff_t, ptrdiff_t, const double*, const double*, const double*, const double*, double*, const double*);
+};
+
+template <bool Batched>
+static constexpr PlaneKernels MakePlaneKernels()
+{
+    return {PlaneKernel<Batched>::Initial, PlaneKernel<Batched>::Boundary, PlaneKernel<Batched>::SourceLine,
+            PlaneKernel<Batched>::Cross,   PlaneKernel<Batched>::Upwind,   PlaneKernel<Batched>::Update};
+}
+
+static inline const PlaneKernels& SelectPlaneKernels(bool batched)
+{
+    static constexpr PlaneKernels kernels[2] = {MakePlaneKernels<false>(), MakePlaneKernels<true>()};
+
+    return kernels[batched];
+}
+
+#endif // KERNEL_H
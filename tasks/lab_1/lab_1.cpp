@@ -1,11 +1,92 @@
 #include "user_mpi.h"
 #include "worker.h"
+#include "wavefront.h"
+#include "ensemble.h"
+#include "parareal.h"
+#include "plane.h"
+#include "config.h"
+#include "topology.h"
 
-#include "unistd.h"
+#include <type_traits>
+
+template <typename Solver>
+static int Solve(UserMpi::MPI* master, const Config& config, Solver* solver)
+{
+    if (config.table)
+    {
+        if (solver->OpenSourceTable(master, config.table)) return 1;
+    }
+
+    double start_time = MPI::Wtime();
+    
+    solver->FillInitialConditions();
+    solver->FillFirstLine(master);
+    solver->FillOtherLines(master);
+
+    solver->Gather(master);
+
+    double end_time = MPI::Wtime();
+
+    if (master->getRank() == 0) 
+    {
+        printf("Time: %.5lf\n", end_time - start_time);
+    }
+
+    solver->Report(master);
+
+    if (config.output && config.collect == Collect::File)
+    {
+        if (solver->Write(master, config.output, config.format)) return 1;
+    }
+    else if (config.output && master->getRank() == 0) 
+    {
+        if (solver->Dump(config.output, config.format)) return 1;
+    }
+
+    return 0;
+}
+
+/* The reduced precisions are followed by the same grid on the same ranks in double for the error */
+template <typename Storage, typename Compute>
+static int SolveLine(UserMpi::MPI* master, const Config& config, MPI_Comm line)
+{
+    Worker<Storage, Compute> worker(master->getRank(), master->getCommSize(), config, line);
+    if (worker.Init(master)) return 1;
+
+    if (Solve(master, config, &worker)) return 1;
+
+    if constexpr (!std::is_same_v<Storage, double> || !std::is_same_v<Compute, double>)
+    {
+        /* Nothing is collected or analysed, the stored layers stay on the ranks */
+        Config reference_config = config;
+
+        reference_config.collect     = Collect::File;
+        reference_config.analysis    = nullptr;
+        reference_config.probe_count = 0;
+        reference_config.quiet       = true;
+
+        Worker<double> reference(master->getRank(), master->getCommSize(), reference_config, line);
+        if (reference.Init(master)) return 1;
+
+        if (config.table)
+        {
+            if (reference.OpenSourceTable(master, config.table)) return 1;
+        }
+
+        if (reference.FillInitialConditions()) return 1;
+        if (reference.FillFirstLine(master))   return 1;
+        if (reference.FillOtherLines(master))  return 1;
+
+        return worker.Compare(master, reference);
+    }
+
+    return 0;
+}
 
 int main(int argc, char** argv) 
 {
-    UserMpi::MPI master(&argc, &argv);
+    /* Only the master thread of every rank talks to MPI */
+    UserMpi::MPI master(&argc, &argv, MPI_THREAD_FUNNELED);
     if (master.check()) return 1;
 
     master.setRank(MPI_COMM_WORLD);
@@ -14,41 +95,86 @@ int main(int argc, char** argv)
     master.setCommSize(MPI_COMM_WORLD);
     if (master.check()) return 1;
 
-    int flag = argc > 1; 
+    Config config{};
+    if (ParseConfig(argc, argv, &config, master.getRank() == 0)) return 1;
 
-    cpu_set_t mask;
-    CPU_ZERO(&mask);
-    CPU_SET(master.getRank(), &mask);
-    sched_setaffinity(getpid(), sizeof(cpu_set_t), &mask);
+    if (Topology::Pin(&master, config.threads ? config.threads : 1)) return 1;
 
-    Worker worker(master.getRank(), master.getCommSize());
-    
-    double start_time = MPI::Wtime();
-    
-    worker.FillInitialConditions();
-    worker.FillFirstLine(&master);
-    worker.FillOtherLines(&master);
-
-    if (master.getCommSize() > 1) 
+    if (config.ensemble)
     {
-        worker.Gather(&master);
+        Ensemble ensemble(master.getRank(), master.getCommSize(), config);
+        if (ensemble.Init(&master, config.ensemble)) return 1;
+
+        return Solve(&master, config, &ensemble);
     }
 
-    double end_time = MPI::Wtime();
+    if (config.parareal)
+    {
+        Parareal parareal(master.getRank(), master.getCommSize(), config);
+        if (parareal.Init(&master)) return 1;
 
-    if (master.getRank() == 0) 
+        return Solve(&master, config, &parareal);
+    }
+
+    if (config.plane)
     {
-        printf("Time: %.5lf\n", end_time - start_time);
+        /* A grid of ranks as close to square as the count allows */
+        MPI_Comm grid = MPI_COMM_NULL;
 
-        if (flag)
-        {
-            FILE* file = fopen(argv[1], "w");
-            if (!file) return 1;
+        int dims[2]    = {};
+        int periods[2] = {};
+
+        master.dimsCreate(master.getCommSize(), 2, dims);
+        if (master.check()) return 1;
 
-            worker.Dump(file);
-            fclose(file);
+        master.cartCreate(MPI_COMM_WORLD, 2, dims, periods, 1, &grid);
+        if (master.check()) return 1;
+
+        master.setRank(grid);
+        if (master.check()) return 1;
+
+        int status = 0;
+
+        {
+            Plane plane(master.getRank(), master.getCommSize(), config, grid);
+            status = plane.Init(&master) || Solve(&master, config, &plane);
         }
+
+        master.commFree(&grid);
+
+        return status;
     }
 
-    return 0;
+    if (config.stages)
+    {
+        Wavefront wavefront(master.getRank(), master.getCommSize(), config);
+        if (wavefront.Init(&master)) return 1;
+
+        return Solve(&master, config, &wavefront);
+    }
+
+    /* A line of ranks, the library may renumber them to keep the neighbours close */
+    MPI_Comm line = MPI_COMM_NULL;
+
+    int dims[1]    = {master.getCommSize()};
+    int periods[1] = {0};
+
+    master.cartCreate(MPI_COMM_WORLD, 1, dims, periods, 1, &line);
+    if (master.check()) return 1;
+
+    master.setRank(line);
+    if (master.check()) return 1;
+
+    int status = 0;
+
+    switch (config.precision)
+    {
+        case Precision::Double: status = SolveLine<double, double>(&master, config, line); break;
+        case Precision::Float:  status = SolveLine<float,  float> (&master, config, line); break;
+        case Precision::Mixed:  status = SolveLine<float,  double>(&master, config, line); break;
+    }
+
+    master.commFree(&line);
+
+    return status;
 }
@@ -0,0 +1,221 @@
+#include "output.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace Output
+{
+
+/* Text cells have a fixed width, so the block of every rank lands at a known offset */
+static constexpr int width = 25;
+
+Header MakeHeader(Layout layout, int inversed, double X, double T, double h, double tau, size_t M, size_t K)
+{
+    Header header{};
+
+    memcpy(header.magic, magic, sizeof(magic));
+
+    header.version  = version;
+    header.layout   = static_cast<uint32_t>(layout);
+    header.inversed = inversed;
+
+    header.X   = X;
+    header.T   = T;
+    header.h   = h;
+    header.tau = tau;
+
+    header.M = M;
+    header.K = K;
+
+    header.offset = offset;
+
+    return header;
+}
+
+int FormatTextHeader(const Header& header, char* buffer, size_t size)
+{
+    return snprintf(buffer, size, "X:   %lg\nh:   %lg\nT:   %lg\ntau: %lg\nM:   %lu\nK:   %lu\n",
+                    header.X, header.h, header.T, header.tau, header.M, header.K);
+}
+
+void GetShape(const Header& header, size_t* rows, size_t* cols)
+{
+    bool tx = header.layout == static_cast<uint32_t>(Layout::TX);
+
+    *rows = tx ? header.K : header.M;
+    *cols = tx ? header.M : header.K;
+}
+
+int Dump(FILE* file, Format format, const Header& header, const Block& block)
+{
+    size_t rows = 0;
+    size_t cols = 0;
+    GetShape(header, &rows, &cols);
+
+    if (format == Format::Binary)
+    {
+        char padding[offset] = {};
+        memcpy(padding, &header, sizeof(header));
+
+        if (fwrite(padding, 1, offset, file) != offset) return 1;
+
+        for (size_t i = 0; i < rows; i++)
+        {
+            if (fwrite(block.data + i * block.stride, sizeof(double), cols, file) != cols) return 1;
+        }
+
+        return 0;
+    }
+
+    char text[256] = "";
+    FormatTextHeader(header, text, sizeof(text));
+
+    fputs(text, file);
+
+    for (size_t i = 0; i < header.K; i++)
+    {   
+        for (size_t j = 0; j < header.M; j++)
+        {
+            if (header.layout == static_cast<uint32_t>(Layout::XT))
+            {
+                fprintf(file, "%lg\n", block.data[j * block.stride + i]);   
+            }
+            else
+            {
+                fprintf(file, "%lg\n", block.data[i * block.stride + j]);
+            }
+        }
+    }
+
+    return 0;
+}
+
+int Write(UserMpi::MPI* master, MPI_Comm comm, const char* path, Format format,
+          const Header& header, const std::vector<Block>& blocks)
+{
+    bool text = (format == Format::Text);
+
+    /* The text file is always t-major */
+    bool transpose = text && header.layout == static_cast<uint32_t>(Layout::XT);
+
+    size_t rows = 0;
+    size_t cols = 0;
+    GetShape(header, &rows, &cols);
+
+    size_t file_rows = transpose ? cols : rows;
+    size_t file_cols = transpose ? rows : cols;
+
+    size_t cell = text ? width : sizeof(double);
+
+    int rank = master->commRank(comm);
+    if (master->check()) return 1;
+
+    unsigned long long count     = blocks.size();
+    unsigned long long max_count = 0;
+
+    master->allreduce(&count, &max_count, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, comm);
+    if (master->check()) return 1;
+
+    char text_header[256] = "";
+    MPI_Offset disp = text ? FormatTextHeader(header, text_header, sizeof(text_header)) : header.offset;
+
+    MPI_File file;
+    MPI_Datatype element = MPI_DOUBLE;
+
+    master->fileOpen(comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, &file);
+    if (master->check()) return 1;
+
+    master->fileSetSize(file, disp + static_cast<MPI_Offset>(rows * cols * cell));
+    if (master->check()) return 1;
+
+    if (rank == 0)
+    {
+        if (text)
+        {
+            master->fileWriteAt(file, 0, text_header, disp, MPI_CHAR);
+        }
+        else
+        {
+            master->fileWriteAt(file, 0, &header, sizeof(header), MPI_BYTE);
+        }
+
+        if (master->check()) return 1;
+    }
+
+    if (text)
+    {
+        master->typeContiguous(width, MPI_CHAR, &element);
+        if (master->check()) return 1;
+
+        master->typeCommit(&element);
+        if (master->check()) return 1;
+    }
+
+    /* Ranks may own different numbers of blocks, the missing ones are written as empty */
+    for (size_t b = 0; b < max_count; b++)
+    {
+        Block block = (b < blocks.size()) ? blocks[b] : Block{};
+
+        size_t block_rows = transpose ? block.cols : block.rows;
+        size_t block_cols = transpose ? block.rows : block.cols;
+        size_t cells = block_rows * block_cols;
+
+        std::vector<char> buffer(cells * cell + 1);
+
+        for (size_t i = 0; i < block_rows; i++)
+        {
+            if (!text)
+            {
+                memcpy(buffer.data() + i * block_cols * cell, block.data + i * block.stride, block_cols * cell);
+                continue;
+            }
+
+            for (size_t j = 0; j < block_cols; j++)
+            {
+                double value = transpose ? block.data[j * block.stride + i] : block.data[i * block.stride + j];
+
+                snprintf(buffer.data() + (i * block_cols + j) * cell, cell + 1, "%24.16le\n", value);
+            }
+        }
+
+        MPI_Datatype filetype = element;
+
+        if (cells)
+        {
+            int sizes[2]    = {static_cast<int>(file_rows),  static_cast<int>(file_cols)};
+            int subsizes[2] = {static_cast<int>(block_rows), static_cast<int>(block_cols)};
+            int starts[2]   = {static_cast<int>(transpose ? block.col : block.row),
+                               static_cast<int>(transpose ? block.row : block.col)};
+
+            master->typeSubarray(2, sizes, subsizes, starts, element, &filetype);
+            if (master->check()) return 1;
+
+            master->typeCommit(&filetype);
+            if (master->check()) return 1;
+        }
+
+        master->fileSetView(file, disp, element, filetype);
+        if (master->check()) return 1;
+
+        master->fileWriteAll(file, buffer.data(), cells, element);
+        if (master->check()) return 1;
+
+        if (filetype != element)
+        {
+            master->typeFree(&filetype);
+            if (master->check()) return 1;
+        }
+    }
+
+    master->fileClose(&file);
+    if (master->check()) return 1;
+
+    if (text)
+    {
+        master->typeFree(&element);
+    }
+
+    return master->check();
+}
+
+}; // namespace Output
@@ -0,0 +1,84 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "user_mpi.h"
+
+namespace Output
+{
+
+enum class Format
+{
+    Text,   // header lines and one value per line, t-major
+    Binary, // Header followed by the raw doubles in the stored layout
+};
+
+enum class Layout : uint32_t
+{
+    TX = 0, // rows are time layers:    u[K][M]
+    XT = 1, // rows are space columns:  u[M][K]
+};
+
+/**
+ * @brief Header of the binary output, the doubles start at offset
+ * @note  The file can be mapped directly, e.g. with numpy:
+ *        np.memmap(path, dtype='<f8', mode='r', offset=offset, shape=(rows, cols))
+ *        where (rows, cols) is (K, M) for the TX layout and (M, K) for the XT layout
+ */
+struct Header
+{
+    char     magic[8];  // "LAB1BIN"
+    uint32_t version;
+    uint32_t layout;
+    uint32_t inversed;
+    uint32_t reserved;
+
+    double   X;
+    double   T;
+    double   h;
+    double   tau;
+
+    uint64_t M;
+    uint64_t K;
+
+    uint64_t offset;
+};
+
+static constexpr char     magic[8] = "LAB1BIN";
+static constexpr uint32_t version  = 1;
+static constexpr uint64_t offset   = 128;
+
+static_assert(sizeof(Header) <= offset, "Binary header does not fit before the data");
+
+/* A rectangle of the stored field owned by this rank, in the stored (layout) coordinates */
+struct Block
+{
+    size_t row;
+    size_t col;
+
+    size_t rows;
+    size_t cols;
+
+    size_t stride;
+    const double* data;
+};
+
+Header MakeHeader(Layout layout, int inversed, double X, double T, double h, double tau, size_t M, size_t K);
+
+/* Stored (rows, cols) of the field */
+void GetShape(const Header& header, size_t* rows, size_t* cols);
+
+int FormatTextHeader(const Header& header, char* buffer, size_t size);
+
+/* Writes the whole field from one rank */
+int Dump(FILE* file, Format format, const Header& header, const Block& block);
+
+/* Every rank of comm writes its blocks into the shared file with collective MPI-IO */
+int Write(UserMpi::MPI* master, MPI_Comm comm, const char* path, Format format,
+          const Header& header, const std::vector<Block>& blocks);
+
+}; // namespace Output
+
+#endif // OUTPUT_H
@@ -0,0 +1,403 @@
+#include "parareal.h"
+
+#include <err.h>
+#include <math.h>
+#include <algorithm>
+
+Parareal::Parareal(int rank, int commSize, const Config& config) :
+    m_rank{rank},
+    m_commSize{commSize},
+    m_problem{config.problem},
+    m_M{m_problem.M()},
+    m_K{m_problem.K()},
+    m_tau{m_problem.tau},
+    m_h{m_problem.h},
+    m_inversed{0},
+    m_batched{config.evaluator == Evaluator::Batched},
+    m_quiet{config.quiet},
+    m_scheme{},
+    m_coarse{},
+    m_kernels{nullptr},
+    m_factor{config.parareal},
+    m_tolerance{config.tolerance},
+    m_first{0},
+    m_last{0},
+    m_steps{0},
+    m_origin{0},
+    m_every{config.stream ? config.stream : 1},
+    m_rows{0},
+    m_row{0},
+    m_count{0},
+    m_collect{config.collect},
+    m_input{},
+    m_previous{},
+    m_output{},
+    m_fine{},
+    m_coarse_old{},
+    m_coarse_new{},
+    m_ring{},
+    m_frow{},
+    m_work{},
+    m_history{},
+    m_result{},
+    m_iterations{0},
+    m_change{0}
+{}
+
+int Parareal::Init(UserMpi::MPI* /* master */)
+{
+    m_inversed = !(m_problem.a * m_tau / m_h < 1);
+
+    if (m_rank == 0 && !m_quiet)
+    {
+        printf("Mode: %s\nInversed: %s\nParareal: %d slices, coarse factor %lu\n",
+               ((m_M < m_K) != m_inversed) ? "slow" : "fast", m_inversed ? "true" : "false", m_commSize, m_factor);
+    }
+
+    if (m_inversed)
+    {
+        std::swap(m_M, m_K);
+        std::swap(m_h, m_tau);
+    }
+
+    /* Every slice makes at least one layer */
+    if (m_K - 2 < static_cast<size_t>(m_commSize))
+    {
+        if (m_rank == 0)
+        {
+            warnx("Parareal: %lu steps do not split into %d slices", m_K - 2, m_commSize);
+        }
+
+        return 1;
+    }
+
+    GetSlice(m_rank, &m_first, &m_last);
+    GetRows(m_rank, &m_row, &m_count);
+
+    m_scheme  = {m_problem.a, m_tau, m_h, 0, {m_problem.X, m_problem.T}};
+    m_kernels = &SelectKernels(m_inversed, m_batched);
+
+    /* The coarse steps cover the slice up to the layer m_last - 1, the last one is a fine corner step */
+    size_t span = m_last - 1 - m_first;
+
+    m_steps = (span + m_factor - 1) / m_factor;
+
+    if (m_steps)
+    {
+        m_coarse     = m_scheme;
+        m_coarse.tau = m_tau * span / m_steps;
+        m_origin     = m_first * m_tau / m_coarse.tau;
+    }
+
+    m_rows = (m_K - 1) / m_every + 1;
+
+    m_input.assign(2 * m_M, 0);
+    m_previous.assign(2 * m_M, 0);
+    m_output.assign(2 * m_M, 0);
+    m_fine.assign(2 * m_M, 0);
+    m_coarse_old.assign(2 * m_M, 0);
+    m_coarse_new.assign(2 * m_M, 0);
+
+    m_ring.assign(3 * m_M, 0);
+    m_frow.assign(m_M, 0);
+    m_work.assign(2 * m_M, 0);
+
+    m_history.assign(m_count * m_M, 0);
+
+    if (m_rank == 0 && m_collect == Collect::Gather)
+    {
+        m_result.assign(m_rows * m_M, 0);
+    }
+
+    return 0;
+}
+
+int Parareal::OpenSourceTable(UserMpi::MPI* /* master */, const char* /* path */)
+{
+    if (m_rank == 0)
+    {
+        warnx("Parareal: the source table is not supported");
+    }
+
+    return 1;
+}
+
+void Parareal::GetSlice(int rank, size_t* first, size_t* last) const
+{
+    size_t steps = m_K - 2;
+    size_t base  = steps / m_commSize;
+    size_t rest  = steps % m_commSize;
+
+    *first = 1 + rank * base + std::min<size_t>(rank, rest);
+    *last  = *first + base + (static_cast<size_t>(rank) < rest);
+}
+
+void Parareal::GetRows(int rank, size_t* row, size_t* count) const
+{
+    size_t first = 0;
+    size_t last  = 0;
+    GetSlice(rank, &first, &last);
+
+    /* The own layers are [begin, last], the stored rows are the multiples of m_every in them */
+    size_t begin = (rank == 0) ? 0 : first + 1;
+
+    *row   = (begin + m_every - 1) / m_every;
+    *count = last / m_every + 1 - *row;
+}
+
+void Parareal::Store(size_t k, const double* layer)
+{
+    if (k % m_every == 0)
+    {
+        memcpy(m_history.data() + (k / m_every - m_row) * m_M, layer, m_M * sizeof(double));
+    }
+}
+
+int Parareal::FillInitialConditions()
+{
+    if (m_rank == 0)
+    {
+        for (size_t m = 0; m < m_M; m++)
+        {
+            m_input[m] = m_kernels->initial(m_scheme, m);
+        }
+
+        Store(0, m_input.data());
+    }
+
+    return 0;
+}
+
+int Parareal::FillFirstLine(UserMpi::MPI* /* master */)
+{
+    if (m_rank == 0)
+    {
+        double* zero = m_input.data();
+        double* one  = m_input.data() + m_M;
+
+        one[0] = m_kernels->boundary(m_scheme, 1);
+
+        m_kernels->firstLine(m_scheme, 1, m_M, zero, one, one[0], zero[0]);
+
+        Store(1, one);
+    }
+
+    return 0;
+}
+
+void Parareal::CornerStep(const Scheme& s, double k, const double* curr, double* next) const
+{
+    next[0] = m_kernels->boundary(s, k + 1);
+
+    for (size_t m = 1; m < m_M; m++)
+    {
+        next[m] = m_kernels->corner(s, next[m - 1], curr[m - 1], curr[m], m_kernels->source(s, k + 0.5, m + 0.5));
+    }
+}
+
+/* The same sweep as Worker on one rank, so the converged layers are the same to the last bit */
+void Parareal::Fine(const double* in, double* out, bool store)
+{
+    memcpy(Row(m_first - 1), in,         m_M * sizeof(double));
+    memcpy(Row(m_first),     in + m_M,   m_M * sizeof(double));
+
+    for (size_t k = m_first; k < m_last; k++)
+    {
+        m_kernels->sourceRow(m_scheme, k, 1, m_M - 1, m_frow.data());
+        m_kernels->update(m_scheme, 1, m_M - 1, Row(k - 1), Row(k), Row(k + 1), m_frow.data());
+
+        Row(k + 1)[0]       = m_kernels->boundary(m_scheme, k + 1);
+        Row(k + 1)[m_M - 1] = m_kernels->edge(m_scheme, k, m_M - 1, Row(k), Row(k + 1));
+
+        if (store)
+        {
+            Store(k + 1, Row(k + 1));
+        }
+    }
+
+    if (out)
+    {
+        memcpy(out,       Row(m_last - 1), m_M * sizeof(double));
+        memcpy(out + m_M, Row(m_last),     m_M * sizeof(double));
+    }
+}
+
+/* The corner scheme needs only the last layer of the state */
+void Parareal::Coarse(const double* in, double* out)
+{
+    const double* curr = in + m_M;
+
+    for (size_t step = 0; step < m_steps; step++)
+    {
+        double* next = m_work.data() + (step % 2) * m_M;
+
+        CornerStep(m_coarse, m_origin + step, curr, next);
+
+        curr = next;
+    }
+
+    memcpy(out, curr, m_M * sizeof(double));
+
+    CornerStep(m_scheme, m_last - 1, out, out + m_M);
+}
+
+int Parareal::FillOtherLines(UserMpi::MPI* master)
+{
+    bool left  = (m_rank != 0);
+    bool right = (m_rank != m_commSize - 1);
+
+    size_t size = 2 * m_M;
+
+    /* Iteration 0: the coarse guess pipelined over the slices */
+    if (left)
+    {
+        master->recv(m_input.data(), size, MPI::DOUBLE, m_rank - 1, MPI_ANY_TAG, MPI_COMM_WORLD);
+        if (master->check()) return 1;
+    }
+
+    Coarse(m_input.data(), m_coarse_old.data());
+
+    if (right)
+    {
+        master->send(m_coarse_old.data(), size, MPI::DOUBLE, m_rank + 1, 0, MPI_COMM_WORLD);
+        if (master->check()) return 1;
+    }
+
+    for (size_t j = 1; j < static_cast<size_t>(m_commSize); j++)
+    {
+        /* The input of the slice n is exact since the iteration n, so its output since n + 1 */
+        bool settled = (static_cast<size_t>(m_rank) + 1 < j);
+
+        if (!settled)
+        {
+            Fine(m_input.data(), m_fine.data(), false);
+        }
+
+        std::swap(m_input, m_previous);
+
+        if (left)
+        {
+            master->recv(m_input.data(), size, MPI::DOUBLE, m_rank - 1, MPI_ANY_TAG, MPI_COMM_WORLD);
+            if (master->check()) return 1;
+        }
+        else
+        {
+            m_input = m_previous;
+        }
+
+        double change = 0;
+
+        for (size_t i = 0; i < size; i++)
+        {
+            change = std::max(change, fabs(m_input[i] - m_previous[i]));
+        }
+
+        if (!settled)
+        {
+            Coarse(m_input.data(), m_coarse_new.data());
+
+            /* With the same coarse state the correction is zero and the fine one goes unchanged */
+            for (size_t i = 0; i < size; i++)
+            {
+                m_output[i] = m_fine[i] + (m_coarse_new[i] - m_coarse_old[i]);
+            }
+
+            std::swap(m_coarse_old, m_coarse_new);
+        }
+
+        if (right)
+        {
+            master->send(m_output.data(), size, MPI::DOUBLE, m_rank + 1, 0, MPI_COMM_WORLD);
+            if (master->check()) return 1;
+        }
+
+        master->allreduce(&change, &m_change, 1, MPI::DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        if (master->check()) return 1;
+
+        m_iterations = j;
+
+        if (m_change <= m_tolerance) break;
+    }
+
+    Fine(m_input.data(), nullptr, true);
+
+    return 0;
+}
+
+Output::Header Parareal::GetHeader(size_t every) const
+{
+    /* Stored rows follow the marching axis, which is x in the inversed mode */
+    size_t rows = (m_K - 1) / every + 1;
+    size_t cols = m_M;
+
+    return Output::MakeHeader(m_inversed ? Output::Layout::XT : Output::Layout::TX, m_inversed,
+                              m_problem.X, m_problem.T,
+                              m_inversed ? m_tau * every : m_h,
+                              m_inversed ? m_h : m_tau * every,
+                              m_inversed ? rows : cols,
+                              m_inversed ? cols : rows);
+}
+
+int Parareal::Dump(const char* path, Output::Format format)
+{
+    Output::Header header = GetHeader(m_every);
+
+    FILE* file = fopen(path, "w");
+    if (!file) return 1;
+
+    int status = Output::Dump(file, format, header, {0, 0, m_rows, m_M, m_M, m_result.data()});
+
+    fclose(file);
+
+    return status;
+}
+
+int Parareal::Gather(UserMpi::MPI* master)
+{
+    if (m_collect != Collect::Gather)
+    {
+        return 0;
+    }
+
+    /* The slices are consecutive runs of whole rows */
+    std::vector<int> counts(m_commSize);
+    std::vector<int> displs(m_commSize);
+
+    for (int rank = 0; rank < m_commSize; rank++)
+    {
+        size_t row   = 0;
+        size_t count = 0;
+        GetRows(rank, &row, &count);
+
+        counts[rank] = count * m_M;
+        displs[rank] = row   * m_M;
+    }
+
+    master->gatherv(m_history.data(), m_count * m_M, MPI::DOUBLE,
+                    m_result.data(), counts.data(), displs.data(), MPI::DOUBLE, 0, MPI_COMM_WORLD);
+
+    return master->check();
+}
+
+int Parareal::Write(UserMpi::MPI* master, const char* path, Output::Format format)
+{
+    std::vector<Output::Block> blocks;
+
+    if (m_count)
+    {
+        blocks.push_back({m_row, 0, m_count, m_M, m_M, m_history.data()});
+    }
+
+    return Output::Write(master, MPI_COMM_WORLD, path, format, GetHeader(m_every), blocks);
+}
+
+int Parareal::Report(UserMpi::MPI* /* master */)
+{
+    if (m_rank == 0 && m_commSize > 1)
+    {
+        printf("Iterations: %lu\n", m_iterations);
+        printf("Correction: %lg\n", m_change);
+    }
+
+    return 0;
+}
@@ -0,0 +1,132 @@
+#ifndef PARAREAL_H
+#define PARAREAL_H
+
+#include <vector>
+#include <memory.h>
+
+#include "user_mpi.h"
+#include "equation.h"
+#include "kernel.h"
+#include "config.h"
+#include "output.h"
+
+/**
+ * @brief Parareal: the steps along the marching axis are split between the ranks, every rank
+ *        holds whole layers of its own slice of steps
+ * @note  The state passed between the slices is the pair of the last two layers. The fine
+ *        propagator F is the cross scheme of Worker, the coarse one G is the corner scheme
+ *        with the step c times longer, which is stable for any step. Iteration 0 pipelines
+ *        G over the slices, iteration j computes F of the old states on every rank at once
+ *        and pipelines the correction U[n + 1] = F(U[n]) + G(U[n]) - G(U[n]) of the old and
+ *        the new states. After j iterations the first j states are exact, so at most P - 1
+ *        iterations are run; the ranks stop earlier once the states change by no more than
+ *        the tolerance. A final F sweep of every slice fills the stored layers.
+ */
+class Parareal
+{
+public:
+    explicit Parareal(int rank, int commSize, const Config& config);
+
+    Parareal(const Parareal& parareal) = delete;
+
+    int Init(UserMpi::MPI* master);
+
+    /* The source term is always computed, see ParseConfig */
+    int OpenSourceTable(UserMpi::MPI* master, const char* path);
+
+    int FillInitialConditions();
+
+    int FillFirstLine(UserMpi::MPI* master);
+
+    int FillOtherLines(UserMpi::MPI* master);
+
+    int Dump(const char* path, Output::Format format);
+
+    int Gather(UserMpi::MPI* master);
+
+    int Write(UserMpi::MPI* master, const char* path, Output::Format format);
+
+    int Report(UserMpi::MPI* master);
+
+private:
+    /* The steps [first, last) of the slice of rank, they make the layers (first, last] */
+    void GetSlice(int rank, size_t* first, size_t* last) const;
+
+    /* The stored rows of rank: the layers k % m_every == 0 of its slice, rank 0 also has 0 and 1 */
+    void GetRows(int rank, size_t* row, size_t* count) const;
+
+    Output::Header GetHeader(size_t every) const;
+
+    void Store(size_t k, const double* layer);
+
+    /* One corner step of the whole layer from the marching coordinate k of s */
+    void CornerStep(const Scheme& s, double k, const double* curr, double* next) const;
+
+    /* Both propagators map the state (m_first - 1, m_first) in to the state (m_last - 1, m_last) out */
+    void Fine(const double* in, double* out, bool store);
+
+    void Coarse(const double* in, double* out);
+
+    /* The layer k of the fine ring */
+    inline double* Row(size_t k)
+    {
+        return m_ring.data() + (k % 3) * m_M;
+    }
+
+    int m_rank;
+    int m_commSize;
+
+    Equation::Problem m_problem;
+
+    size_t m_M;
+    size_t m_K;
+
+    double m_tau;
+    double m_h;
+
+    int  m_inversed;
+    bool m_batched;
+    bool m_quiet;
+
+    Scheme m_scheme;
+    Scheme m_coarse;
+    const Kernels* m_kernels;
+
+    size_t m_factor;    // coarse steps are up to m_factor fine ones
+    double m_tolerance;
+
+    size_t m_first;
+    size_t m_last;
+
+    /* The coarse steps of the slice and the marching coordinate of the first one in them */
+    size_t m_steps;
+    double m_origin;
+
+    size_t m_every;
+    size_t m_rows;
+    size_t m_row;   // the first own stored row
+    size_t m_count; // own stored rows
+
+    Collect m_collect;
+
+    /* The states are two layers [layer k - 1 | layer k] */
+    std::vector<double> m_input;
+    std::vector<double> m_previous;
+    std::vector<double> m_output;
+    std::vector<double> m_fine;
+    std::vector<double> m_coarse_old;
+    std::vector<double> m_coarse_new;
+
+    std::vector<double> m_ring; // three layers of the fine sweep
+    std::vector<double> m_frow; // source term of the layer being computed
+    std::vector<double> m_work; // two layers of the coarse sweep
+
+    std::vector<double> m_history; // the own stored rows
+    std::vector<double> m_result;  // rank 0: all of them
+
+    size_t m_iterations;
+    double m_change;
+
+}; // class Parareal
+
+#endif // PARAREAL_H
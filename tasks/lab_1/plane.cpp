@@ -0,0 +1,392 @@
+#include "plane.h"
+
+#include <err.h>
+#include <algorithm>
+
+Plane::Plane(int rank, int commSize, const Config& config, MPI_Comm comm) :
+    m_rank{rank},
+    m_commSize{commSize},
+    m_comm{comm},
+    m_dims{},
+    m_coords{},
+    m_neighbors{MPI_PROC_NULL, MPI_PROC_NULL, MPI_PROC_NULL, MPI_PROC_NULL},
+    m_problem{config.problem},
+    m_Y{config.Y ? config.Y : m_problem.X},
+    m_Mx{m_problem.M()},
+    m_My{static_cast<size_t>(m_Y / m_problem.h)},
+    m_K{m_problem.K()},
+    m_batched{config.evaluator == Evaluator::Batched},
+    m_quiet{config.quiet},
+    m_scheme{config.problem.a, config.plane, m_problem.tau, m_problem.h, 0, 0, {m_problem.X, m_Y, m_problem.T}},
+    m_kernels{nullptr},
+    m_x0{0},
+    m_y0{0},
+    m_nx{0},
+    m_ny{0},
+    m_stride{0},
+    m_collect{config.collect},
+    m_data{},
+    m_frow{},
+    m_row{MPI_DATATYPE_NULL},
+    m_plans{},
+    m_result{},
+    m_stats{}
+{}
+
+void Plane::Split(size_t count, int parts, int coord, size_t* start, size_t* part)
+{
+    *start = coord * (count / parts) + std::min<size_t>(coord, count % parts);
+    *part  = count / parts + (static_cast<size_t>(coord) < count % parts);
+}
+
+int Plane::Init(UserMpi::MPI* master)
+{
+    int periods[2] = {};
+
+    master->cartGet(m_comm, 2, m_dims, periods, m_coords);
+    if (master->check()) return 1;
+
+    if (m_rank == 0 && !m_quiet)
+    {
+        printf("Plane: %lu x %lu cells, %d x %d ranks\n", m_Mx, m_My, m_dims[0], m_dims[1]);
+    }
+
+    /* The cross scheme and the upwind one both hold while the two Courant numbers add up below 1 */
+    if (!((m_scheme.a + m_scheme.b) * m_scheme.tau / m_scheme.h < 1))
+    {
+        if (m_rank == 0)
+        {
+            warnx("Plane: (a + b) * tau / h = %lg, the plane has no inversed mode",
+                  (m_scheme.a + m_scheme.b) * m_scheme.tau / m_scheme.h);
+        }
+
+        return 1;
+    }
+
+    Split(m_Mx, m_dims[0], m_coords[0], &m_x0, &m_nx);
+    Split(m_My, m_dims[1], m_coords[1], &m_y0, &m_ny);
+
+    if (m_Mx < 2 * static_cast<size_t>(m_dims[0]) || m_My < 2 * static_cast<size_t>(m_dims[1]))
+    {
+        if (m_rank == 0)
+        {
+            warnx("Plane: %lu x %lu cells do not split into %d x %d blocks at least two cells wide",
+                  m_Mx, m_My, m_dims[0], m_dims[1]);
+        }
+
+        return 1;
+    }
+
+    master->cartShift(m_comm, 0, 1, &m_neighbors[0], &m_neighbors[1]);
+    if (master->check()) return 1;
+
+    master->cartShift(m_comm, 1, 1, &m_neighbors[2], &m_neighbors[3]);
+    if (master->check()) return 1;
+
+    m_scheme.x0 = m_x0;
+    m_scheme.y0 = m_y0;
+    m_kernels   = &SelectPlaneKernels(m_batched);
+
+    m_stride = m_ny + 2;
+
+    m_data.assign(3 * (m_nx + 2) * m_stride, 0);
+    m_frow.assign(m_ny, 0);
+
+    if (m_rank == 0 && m_collect == Collect::Gather)
+    {
+        m_result.assign(m_Mx * m_My, 0);
+    }
+
+    /* A row of constant y crosses the columns */
+    master->typeVector(m_nx, 1, m_stride, MPI::DOUBLE, &m_row);
+    if (master->check()) return 1;
+
+    master->typeCommit(&m_row);
+    if (master->check()) return 1;
+
+    /* Own edge lines out, the ghost lines in, the tag is the side the line leaves from */
+    for (size_t slot = 0; slot < 3; slot++)
+    {
+        struct
+        {
+            int           neighbor;
+            const double* send;
+            double*       recv;
+            int           count;
+            MPI_Datatype  type;
+            int           tag;
+        }
+        const lines[] =
+        {
+            {m_neighbors[0], Column(slot, 0),                Column(slot, -1),                      static_cast<int>(m_ny), MPI::DOUBLE, 0},
+            {m_neighbors[1], Column(slot, m_nx - 1),         Column(slot, m_nx),                    static_cast<int>(m_ny), MPI::DOUBLE, 1},
+            {m_neighbors[2], Column(slot, 0),                Column(slot, 0) - 1,                   1,                      m_row,       2},
+            {m_neighbors[3], Column(slot, 0) + m_ny - 1,     Column(slot, 0) + m_ny,                1,                      m_row,       3},
+        };
+
+        for (const auto& line : lines)
+        {
+            if (line.neighbor == MPI_PROC_NULL) continue;
+
+            m_plans[slot].send(master, line.send, line.count, line.type, line.neighbor, line.tag, m_comm);
+            if (master->check()) return 1;
+
+            /* The neighbour sends the opposite way */
+            m_plans[slot].recv(master, line.recv, line.count, line.type, line.neighbor, line.tag ^ 1, m_comm);
+            if (master->check()) return 1;
+        }
+    }
+
+    return 0;
+}
+
+int Plane::OpenSourceTable(UserMpi::MPI* /* master */, const char* /* path */)
+{
+    if (m_rank == 0)
+    {
+        warnx("Plane: the source table is not supported");
+    }
+
+    return 1;
+}
+
+int Plane::StartHalo(UserMpi::MPI* master, size_t k)
+{
+    UserMpi::Plan& plan = m_plans[k % 3];
+
+    if (plan.size())
+    {
+        plan.start(master);
+        if (master->check()) return 1;
+
+        m_stats.messages += plan.size() / 2;
+
+        for (int side = 0; side < 4; side++)
+        {
+            if (m_neighbors[side] != MPI_PROC_NULL)
+            {
+                m_stats.bytes += ((side < 2) ? m_ny : m_nx) * sizeof(double);
+            }
+        }
+    }
+
+    return 0;
+}
+
+int Plane::FillInitialConditions()
+{
+    for (size_t i = 0; i < m_nx; i++)
+    {
+        for (size_t j = 0; j < m_ny; j++)
+        {
+            Column(0, i)[j] = m_kernels->initial(m_scheme, i, j);
+        }
+    }
+
+    return 0;
+}
+
+void Plane::FillCell(size_t k, ptrdiff_t i, ptrdiff_t j, double f)
+{
+    size_t x = m_x0 + i;
+    size_t y = m_y0 + j;
+
+    const double* curr = Column(k, i);
+    double*       next = Column(k + 1, i);
+
+    if (x == 0 || y == 0)
+    {
+        next[j] = m_kernels->boundary(m_scheme, k + 1, i, j);
+    }
+    else if (k == 0 || x == m_Mx - 1 || y == m_My - 1)
+    {
+        next[j] = m_kernels->upwind(m_scheme, curr[j], Column(k, i - 1)[j], curr[j - 1], f);
+    }
+    else
+    {
+        next[j] = m_kernels->cross(m_scheme, Column(k - 1, i)[j], Column(k, i - 1)[j], Column(k, i + 1)[j],
+                                   curr[j - 1], curr[j + 1], f);
+    }
+}
+
+void Plane::FillColumn(size_t k, ptrdiff_t i, ptrdiff_t begin, ptrdiff_t end)
+{
+    m_kernels->sourceLine(m_scheme, k, i, begin, end, m_frow.data());
+
+    for (ptrdiff_t j = begin; j < end; j++)
+    {
+        FillCell(k, i, j, m_frow[j]);
+    }
+}
+
+void Plane::FillFrame(size_t k)
+{
+    ptrdiff_t nx = m_nx;
+    ptrdiff_t ny = m_ny;
+
+    FillColumn(k, 0,      0, ny);
+    FillColumn(k, nx - 1, 0, ny);
+
+    for (ptrdiff_t i = 1; i < nx - 1; i++)
+    {
+        FillColumn(k, i, 0,      1);
+        FillColumn(k, i, ny - 1, ny);
+    }
+}
+
+/* The upwind scheme needs the inflow neighbours of the layer 0 */
+int Plane::FillFirstLine(UserMpi::MPI* master)
+{
+    if (StartHalo(master, 0)) return 1;
+
+    if (m_plans[0].size())
+    {
+        m_plans[0].wait(master);
+        if (master->check()) return 1;
+    }
+
+    for (size_t i = 0; i < m_nx; i++)
+    {
+        FillColumn(0, i, 0, m_ny);
+    }
+
+    return 0;
+}
+
+int Plane::FillOtherLines(UserMpi::MPI* master)
+{
+    ptrdiff_t nx = m_nx;
+    ptrdiff_t ny = m_ny;
+
+    for (size_t k = 1; k < m_K - 1; k++)
+    {
+        if (StartHalo(master, k)) return 1;
+
+        /* The interior reads no ghost cells and no edge of the grid */
+        for (ptrdiff_t i = 1; i < nx - 1; i++)
+        {
+            m_kernels->sourceLine(m_scheme, k, i, 1, ny - 1, m_frow.data());
+            m_kernels->update(m_scheme, 1, ny - 1, Column(k - 1, i), Column(k, i),
+                              Column(k, i - 1), Column(k, i + 1), Column(k + 1, i), m_frow.data());
+        }
+
+        if (m_plans[k % 3].size())
+        {
+            m_plans[k % 3].wait(master);
+            if (master->check()) return 1;
+        }
+
+        FillFrame(k);
+    }
+
+    return 0;
+}
+
+Output::Header Plane::GetHeader() const
+{
+    /* The rows are the columns of constant x, y takes the place of t */
+    return Output::MakeHeader(Output::Layout::XT, 0, m_problem.X, m_Y, m_problem.h, m_problem.h, m_Mx, m_My);
+}
+
+int Plane::Dump(const char* path, Output::Format format)
+{
+    FILE* file = fopen(path, "w");
+    if (!file) return 1;
+
+    int status = Output::Dump(file, format, GetHeader(), {0, 0, m_Mx, m_My, m_My, m_result.data()});
+
+    fclose(file);
+
+    return status;
+}
+
+int Plane::Gather(UserMpi::MPI* master)
+{
+    if (m_collect != Collect::Gather)
+    {
+        return 0;
+    }
+
+    std::vector<double> block(m_nx * m_ny);
+
+    for (size_t i = 0; i < m_nx; i++)
+    {
+        memcpy(block.data() + i * m_ny, Column(m_K - 1, i), m_ny * sizeof(double));
+    }
+
+    /* The blocks arrive packed one after another and are placed by the coordinates of their ranks */
+    std::vector<int>    counts(m_commSize);
+    std::vector<int>    displs(m_commSize);
+    std::vector<double> blocks;
+
+    if (m_rank == 0)
+    {
+        for (int rank = 0, displ = 0; rank < m_commSize; rank++)
+        {
+            int    coords[2] = {};
+            size_t x0 = 0, nx = 0, y0 = 0, ny = 0;
+
+            master->cartCoords(m_comm, rank, 2, coords);
+            if (master->check()) return 1;
+
+            Split(m_Mx, m_dims[0], coords[0], &x0, &nx);
+            Split(m_My, m_dims[1], coords[1], &y0, &ny);
+
+            counts[rank] = nx * ny;
+            displs[rank] = displ;
+
+            displ += counts[rank];
+        }
+
+        blocks.resize(m_Mx * m_My);
+    }
+
+    master->gatherv(block.data(), block.size(), MPI::DOUBLE,
+                    blocks.data(), counts.data(), displs.data(), MPI::DOUBLE, 0, m_comm);
+    if (master->check()) return 1;
+
+    if (m_rank == 0)
+    {
+        for (int rank = 0; rank < m_commSize; rank++)
+        {
+            int    coords[2] = {};
+            size_t x0 = 0, nx = 0, y0 = 0, ny = 0;
+
+            master->cartCoords(m_comm, rank, 2, coords);
+            if (master->check()) return 1;
+
+            Split(m_Mx, m_dims[0], coords[0], &x0, &nx);
+            Split(m_My, m_dims[1], coords[1], &y0, &ny);
+
+            for (size_t i = 0; i < nx; i++)
+            {
+                memcpy(m_result.data() + (x0 + i) * m_My + y0, blocks.data() + displs[rank] + i * ny, ny * sizeof(double));
+            }
+        }
+    }
+
+    return 0;
+}
+
+int Plane::Write(UserMpi::MPI* master, const char* path, Output::Format format)
+{
+    return Output::Write(master, m_comm, path, format, GetHeader(),
+                         {{m_x0, m_y0, m_nx, m_ny, m_stride, Column(m_K - 1, 0)}});
+}
+
+int Plane::Report(UserMpi::MPI* master)
+{
+    unsigned long long local[2] = {m_stats.messages, m_stats.bytes};
+    unsigned long long total[2] = {};
+
+    master->reduce(local, total, 2, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, m_comm);
+    if (master->check()) return 1;
+
+    if (m_rank == 0 && m_commSize > 1)
+    {
+        printf("Messages: %llu\n", total[0]);
+        printf("Bytes: %llu\n",    total[1]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+#ifndef PLANE_H
+#define PLANE_H
+
+#include <vector>
+#include <memory.h>
+
+#include "user_mpi.h"
+#include "equation.h"
+#include "kernel.h"
+#include "config.h"
+#include "output.h"
+
+/**
+ * @brief The plane problem u_t + a * u_x + b * u_y = f on a 2D Cartesian grid of ranks,
+ *        every rank holds a block of the layer with a ghost cell on each side
+ * @note  A layer is stored by columns of constant x, so the ghost columns of the x neighbours
+ *        are contiguous and the ghost rows of the y neighbours are an MPI vector type.
+ *        As in Worker, the interior of the block is computed while the halo of the layer
+ *        is in flight, the frame of the block after it has arrived. The blocks differ
+ *        by at most one cell per axis, so the result does not depend on the grid of ranks.
+ *        Only the last layer is kept and written.
+ */
+class Plane
+{
+public:
+    explicit Plane(int rank, int commSize, const Config& config, MPI_Comm comm);
+
+    Plane(const Plane& plane) = delete;
+
+    ~Plane()
+    {
+        if (m_row != MPI_DATATYPE_NULL)
+        {
+            MPI_Type_free(&m_row);
+        }
+    }
+
+    int Init(UserMpi::MPI* master);
+
+    /* The source term is always computed, see ParseConfig */
+    int OpenSourceTable(UserMpi::MPI* master, const char* path);
+
+    int FillInitialConditions();
+
+    int FillFirstLine(UserMpi::MPI* master);
+
+    int FillOtherLines(UserMpi::MPI* master);
+
+    int Dump(const char* path, Output::Format format);
+
+    int Gather(UserMpi::MPI* master);
+
+    int Write(UserMpi::MPI* master, const char* path, Output::Format format);
+
+    int Report(UserMpi::MPI* master);
+
+private:
+    struct Stats
+    {
+        unsigned long long messages;
+        unsigned long long bytes;
+    };
+
+    /* The part of the axis of count cells owned by the coordinate coord of parts */
+    static void Split(size_t count, int parts, int coord, size_t* start, size_t* part);
+
+    Output::Header GetHeader() const;
+
+    /* Starts the exchange of the layer k, the counters go to m_stats */
+    int StartHalo(UserMpi::MPI* master, size_t k);
+
+    /* The cell (i, j) of the layer k + 1 with its source term f by the scheme of its place */
+    void FillCell(size_t k, ptrdiff_t i, ptrdiff_t j, double f);
+
+    /* The cells [begin, end) of the column i of the layer k + 1, one cell at a time */
+    void FillColumn(size_t k, ptrdiff_t i, ptrdiff_t begin, ptrdiff_t end);
+
+    /* The cells of the layer k + 1 that read the ghost cells of the layer k */
+    void FillFrame(size_t k);
+
+    /* The column i of the layer k, the cells -1 and m_ny are the ghosts */
+    inline double* Column(size_t k, ptrdiff_t i)
+    {
+        return m_data.data() + (k % 3) * (m_nx + 2) * m_stride + (i + 1) * m_stride + 1;
+    }
+
+    int m_rank;
+    int m_commSize;
+
+    MPI_Comm m_comm;
+
+    int m_dims[2];
+    int m_coords[2];
+
+    /* -x, +x, -y, +y */
+    int m_neighbors[4];
+
+    Equation::Problem m_problem;
+
+    double m_Y;
+
+    size_t m_Mx;
+    size_t m_My;
+    size_t m_K;
+
+    bool m_batched;
+    bool m_quiet;
+
+    PlaneScheme         m_scheme;
+    const PlaneKernels* m_kernels;
+
+    size_t m_x0;
+    size_t m_y0;
+    size_t m_nx;
+    size_t m_ny;
+    size_t m_stride; // m_ny + 2
+
+    Collect m_collect;
+
+    std::vector<double> m_data; // three layers of (m_nx + 2) columns of m_stride cells
+    std::vector<double> m_frow; // source term of the column being computed
+
+    /* The ghost rows of the y neighbours */
+    MPI_Datatype m_row;
+
+    /* The layer k is exchanged from its own ring slot, so every slot has its own plan */
+    UserMpi::Plan m_plans[3];
+
+    std::vector<double> m_result; // rank 0: the last layer of all cells
+
+    Stats m_stats;
+
+}; // class Plane
+
+#endif // PLANE_H
@@ -3,6 +3,7 @@
 import os
 import argparse
 import shutil
+import struct
 import numpy as np
 from matplotlib import pyplot as plt
 
@@ -16,6 +17,8 @@ def main():
     parser = argparse.ArgumentParser(description='Run plotting')
     parser.add_argument('-q', '--quiet', dest='quiet', action='store_true',
                         help='Echo system command or not')
+    parser.add_argument('-b', '--binary', dest='binary', action='store_true',
+                        help='Write the solution in the binary format with MPI-IO and map it')
 
     subparsers = parser.add_subparsers(help='targets', dest='target')
 
@@ -26,6 +29,7 @@ def main():
 
     target = args.target
     quiet  = args.quiet
+    binary = args.binary
 
     if not os.path.exists(default_output_dir):
         os.makedirs(default_output_dir)
@@ -35,22 +39,33 @@ def main():
             return 0
 
     if target == 'solution':
-        SolutionGraph(quiet)
+        SolutionGraph(quiet, binary)
 
     elif target == 'time':
         TimeGraph(quiet)
 
 
-def SolutionGraph(quiet):
-    log = os.path.join(default_output_dir, 'output.txt')
+# struct Output::Header from output.h
+header_format = '<8s4I4d3Q'
 
-    command = "mpirun -np " + str(max_proc) + " " + executable + " " + log
+def LoadBinary(path):
+    with open(path, 'rb') as f:
+        fields = struct.unpack(header_format, f.read(struct.calcsize(header_format)))
 
-    if not quiet:
-        print(command)
+    magic, version, layout, inversed, _, X, T, h, tau, M, K, offset = fields
 
-    os.system(command)
+    if magic.rstrip(b'\0') != b'LAB1BIN':
+        raise ValueError(path + ' is not a lab_1 binary output')
 
+    params = {"X": X, "h": h, "T": T, "tau": tau, "M": M, "K": K}
+
+    # Rows of the file follow the marching axis, which is x in the inversed mode
+    shape = (K, M) if layout == 0 else (M, K)
+    U = np.memmap(path, dtype='<f8', mode='r', offset=offset, shape=shape)
+
+    return params, U if layout == 0 else U.T
+
+def LoadText(path):
     params = {
     "X": 0,
     "h": 0,
@@ -62,7 +77,7 @@ def SolutionGraph(quiet):
 
     data = []
 
-    with open(log) as f:
+    with open(path) as f:
         for line in f:
             line = line.split()
             name = line[0]
@@ -72,11 +87,22 @@ def SolutionGraph(quiet):
             else:
                 data.append(float(name))
       
-    U = np.zeros((int(params['K']), int(params['M'])))
+    U = np.array(data).reshape((int(params['K']), int(params['M'])))
+
+    return params, U
+
+def SolutionGraph(quiet, binary):
+    log = os.path.join(default_output_dir, 'output.bin' if binary else 'output.txt')
+
+    options = " --collect file --format binary " if binary else " "
+    command = "mpirun -np " + str(max_proc) + " " + executable + options + log
+
+    if not quiet:
+        print(command)
+
+    os.system(command)
 
-    for i in range(U.shape[0]):
-        for j in range(U.shape[1]):
-            U[i][j] = data[i * U.shape[1] + j]
+    params, U = LoadBinary(log) if binary else LoadText(log)
 
     X = np.array([k * params['h'] for k in range(U.shape[1])])
     T = np.array([k * params['tau'] for k in range(U.shape[0])])
@@ -0,0 +1,120 @@
+#include "source_table.h"
+
+#include <vector>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+SourceTable::~SourceTable()
+{
+    if (m_map)
+    {
+        munmap(m_map, m_size);
+    }
+}
+
+int SourceTable::Map(const char* path, const Output::Header& header)
+{
+    size_t rows = 0;
+    size_t cols = 0;
+    Output::GetShape(header, &rows, &cols);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 1;
+
+    Output::Header stored{};
+    struct stat info{};
+
+    size_t size = header.offset + rows * cols * sizeof(double);
+
+    /* Any difference in the grid or the domain makes the table stale */
+    if (pread(fd, &stored, sizeof(stored), 0) != sizeof(stored) || memcmp(&stored, &header, sizeof(header)) ||
+        fstat(fd, &info) || static_cast<size_t>(info.st_size) < size)
+    {
+        close(fd);
+        return 1;
+    }
+
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) return 1;
+
+    m_map  = map;
+    m_size = size;
+    m_data = reinterpret_cast<const double*>(static_cast<const char*>(map) + header.offset);
+    m_cols = cols;
+
+    return 0;
+}
+
+/**
+ * @note Ranks split the rows, so the table is written by contiguous pieces in one
+ *       collective Output::Write. The values come from the same source kernel as the solver.
+ */
+int SourceTable::Build(UserMpi::MPI* master, MPI_Comm comm, const char* path, const Output::Header& header,
+                       const Scheme& scheme, const Kernels& kernels)
+{
+    size_t rows = 0;
+    size_t cols = 0;
+    Output::GetShape(header, &rows, &cols);
+
+    int rank = master->commRank(comm);
+    if (master->check()) return 1;
+
+    int size = master->commSize(comm);
+    if (master->check()) return 1;
+
+    size_t begin = rows *  rank      / size;
+    size_t end   = rows * (rank + 1) / size;
+
+    Scheme global = scheme;
+    global.start  = 0;
+
+    std::vector<double> data((end - begin) * cols);
+
+    for (size_t k = begin; k < end; k++)
+    {
+        kernels.sourceRow(global, k, 0, cols, data.data() + (k - begin) * cols);
+    }
+
+    std::vector<Output::Block> blocks;
+
+    if (begin < end)
+    {
+        blocks.push_back({begin, 0, end - begin, cols, cols, data.data()});
+    }
+
+    return Output::Write(master, comm, path, Output::Format::Binary, header, blocks);
+}
+
+int SourceTable::Open(UserMpi::MPI* master, MPI_Comm comm, const char* path, const Output::Header& header,
+                      const Scheme& scheme, const Kernels& kernels)
+{
+    int stale = Map(path, header);
+    int any   = 0;
+
+    master->allreduce(&stale, &any, 1, MPI_INT, MPI_MAX, comm);
+    if (master->check()) return 1;
+
+    if (!any) return 0;
+
+    if (m_map)
+    {
+        munmap(m_map, m_size);
+
+        m_map  = nullptr;
+        m_data = nullptr;
+    }
+
+    if (Build(master, comm, path, header, scheme, kernels)) return 1;
+
+    int failed = Map(path, header);
+    
+    master->allreduce(&failed, &any, 1, MPI_INT, MPI_MAX, comm);
+    if (master->check()) return 1;
+
+    return any;
+}
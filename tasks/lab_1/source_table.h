@@ -0,0 +1,63 @@
+#ifndef SOURCE_TABLE_H
+#define SOURCE_TABLE_H
+
+#include <stddef.h>
+
+#include "user_mpi.h"
+#include "output.h"
+#include "kernel.h"
+
+/**
+ * @brief The source term on every grid node, precomputed once and mapped read-only by all ranks
+ * @note  The file is a binary output file (Output::Header in the stored layout), so it does not
+ *        depend on the number of ranks and is rebuilt only when the grid or the domain change.
+ *        Columns past the real grid (the padding) are not stored.
+ */
+class SourceTable
+{
+public:
+    SourceTable() :
+        m_map{nullptr},
+        m_size{0},
+        m_data{nullptr},
+        m_cols{0}
+    {}
+
+    SourceTable(const SourceTable& table) = delete;
+
+    ~SourceTable();
+
+    /* Collective over comm: maps the table at path, building it first if it is missing or stale */
+    int Open(UserMpi::MPI* master, MPI_Comm comm, const char* path, const Output::Header& header,
+             const Scheme& scheme, const Kernels& kernels);
+
+    inline bool IsOpen() const
+    {
+        return m_data != nullptr;
+    }
+
+    inline size_t Cols() const
+    {
+        return m_cols;
+    }
+
+    inline const double* Row(size_t k) const
+    {
+        return m_data + k * m_cols;
+    }
+
+private:
+    int Map(const char* path, const Output::Header& header);
+
+    int Build(UserMpi::MPI* master, MPI_Comm comm, const char* path, const Output::Header& header,
+              const Scheme& scheme, const Kernels& kernels);
+
+    void*  m_map;
+    size_t m_size;
+
+    const double* m_data;
+    size_t        m_cols;
+
+}; // class SourceTable
+
+#endif // SOURCE_TABLE_H
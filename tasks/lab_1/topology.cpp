@@ -0,0 +1,144 @@
+#include "topology.h"
+
+#include <omp.h>
+#include <err.h>
+#include <sched.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <string.h>
+#include <vector>
+#include <tuple>
+#include <algorithm>
+
+namespace Topology
+{
+
+struct Cpu
+{
+    int id;
+    int sibling; // index among the hardware threads of its core
+    int node;
+    int package;
+    int core;
+};
+
+static int ReadValue(const char* path, int fallback)
+{
+    FILE* file = fopen(path, "r");
+    if (!file) return fallback;
+
+    int value = fallback;
+
+    if (fscanf(file, "%d", &value) != 1)
+    {
+        value = fallback;
+    }
+
+    fclose(file);
+
+    return value;
+}
+
+/* The cpu directory links its NUMA node as nodeN */
+static int ReadNode(int id)
+{
+    char path[64] = {};
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", id);
+
+    DIR* dir = opendir(path);
+    if (!dir) return 0;
+
+    int node = 0;
+
+    while (dirent* entry = readdir(dir))
+    {
+        if (strncmp(entry->d_name, "node", 4) == 0 && sscanf(entry->d_name + 4, "%d", &node) == 1) break;
+    }
+
+    closedir(dir);
+
+    return node;
+}
+
+static std::vector<Cpu> ReadCpus()
+{
+    std::vector<Cpu> cpus;
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed)) return cpus;
+
+    for (int id = 0; id < CPU_SETSIZE; id++)
+    {
+        if (!CPU_ISSET(id, &allowed)) continue;
+
+        char path[96] = {};
+        Cpu  cpu{id, 0, ReadNode(id), 0, id};
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", id);
+        cpu.package = ReadValue(path, 0);
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", id);
+        cpu.core = ReadValue(path, id);
+
+        for (const Cpu& other : cpus)
+        {
+            cpu.sibling += (other.package == cpu.package && other.core == cpu.core);
+        }
+
+        cpus.push_back(cpu);
+    }
+
+    std::sort(cpus.begin(), cpus.end(), [](const Cpu& a, const Cpu& b)
+    {
+        return std::tie(a.sibling, a.node, a.package, a.core, a.id) < std::tie(b.sibling, b.node, b.package, b.core, b.id);
+    });
+
+    return cpus;
+}
+
+int Pin(UserMpi::MPI* master, int threads)
+{
+    MPI_Comm node = MPI_COMM_NULL;
+
+    master->commSplitType(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, master->getRank(), &node);
+    if (master->check()) return 1;
+
+    int rank = master->commRank(node);
+    if (master->check()) return 1;
+
+    int size = master->commSize(node);
+    if (master->check()) return 1;
+
+    master->commFree(&node);
+    if (master->check()) return 1;
+
+    std::vector<Cpu> cpus = ReadCpus();
+
+    if (static_cast<size_t>(size) * threads > cpus.size())
+    {
+        if (rank == 0)
+        {
+            warnx("%d ranks x %d threads on %lu CPUs of the node, not pinning", size, threads, cpus.size());
+        }
+
+        return 0;
+    }
+
+    const Cpu* own = cpus.data() + rank * threads;
+
+    /* Every thread pins itself, the runtime keeps the same threads for the later regions */
+    #pragma omp parallel num_threads(threads)
+    {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        CPU_SET(own[omp_get_thread_num()].id, &mask);
+
+        sched_setaffinity(0, sizeof(mask), &mask);
+    }
+
+    return 0;
+}
+
+} // Topology
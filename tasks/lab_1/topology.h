@@ -0,0 +1,22 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include "user_mpi.h"
+
+namespace Topology
+{
+
+/**
+ * @brief Pins the threads of this rank to its own CPUs of the node
+ * @note  Only the CPUs allowed to the process count, so the jobs that share the node through
+ *        cpusets or a batch system do not collide. They are ordered by the /sys topology:
+ *        the first hardware thread of every core by NUMA node, package and core, then the
+ *        siblings. The ranks take consecutive runs of threads CPUs in the order of their
+ *        rank on the node. With fewer CPUs than threads on the node nothing is pinned.
+ *        Collective over MPI_COMM_WORLD, the OpenMP threads are pinned one by one.
+ */
+int Pin(UserMpi::MPI* master, int threads);
+
+} // Topology
+
+#endif // TOPOLOGY_H
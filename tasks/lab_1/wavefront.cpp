@@ -0,0 +1,513 @@
+#include "wavefront.h"
+
+#include <err.h>
+#include <algorithm>
+
+Wavefront::Wavefront(int rank, int commSize, const Config& config) :
+    m_rank{rank},
+    m_commSize{commSize},
+    m_problem{config.problem},
+    m_blocks{std::max<int>(1, commSize / std::max<int>(1, config.stages))},
+    m_stages{std::max<int>(1, config.stages)},
+    m_block{rank % m_blocks},
+    m_stage{rank / m_blocks},
+    m_start{0},
+    m_part{0},
+    m_chunk{config.chunk ? config.chunk : 64},
+    m_M{m_problem.M()},
+    m_K{m_problem.K()},
+    m_tau{m_problem.tau},
+    m_h{m_problem.h},
+    m_inversed{!(m_problem.a * m_problem.tau / m_problem.h < 1)},
+    m_scheme{},
+    m_kernels{nullptr},
+    m_every{config.stream ? config.stream : 1},
+    m_rows{0},
+    m_collect{config.collect},
+    m_space{MPI_COMM_NULL},
+    m_time{MPI_COMM_NULL},
+    m_older{nullptr},
+    m_curr{nullptr},
+    m_next{nullptr},
+    m_received{0},
+    m_stored{0},
+    m_slot{0},
+    m_result{nullptr},
+    m_table{},
+    m_stats{}
+{
+    if (m_rank == 0 && !config.quiet)
+    {
+        printf("Mode: %s\nInversed: %s\n", ((m_M < m_K) != m_inversed) ? "slow" : "fast", m_inversed ? "true" : "false");
+    }
+
+    if (m_inversed)
+    {
+        std::swap(m_M, m_K);
+        std::swap(m_h, m_tau);
+    }
+
+    m_M     = (m_M / m_blocks + !!(m_M % m_blocks)) * m_blocks;
+    m_part  =  m_M / m_blocks;
+    m_start =  m_part * m_block;
+    m_chunk =  std::min(m_chunk, m_part);
+
+    m_scheme  = {m_problem.a, m_tau, m_h, static_cast<ptrdiff_t>(m_start), {m_problem.X, m_problem.T}};
+    m_kernels = &SelectKernels(m_inversed, config.evaluator == Evaluator::Batched);
+
+    m_rows = (m_K - 1) / m_every + 1;
+
+    for (std::vector<double>& layer : m_layers)
+    {
+        layer.assign(m_part + 2, 0);
+    }
+
+    m_older = m_layers[0].data() + 1;
+    m_curr  = m_layers[1].data() + 1;
+    m_next  = m_layers[2].data() + 1;
+
+    m_frow.assign(m_part, 0);
+    m_recv.assign(2 * m_chunk, 0);
+
+    /* Every chunk of both layers and the two edge columns */
+    m_send[0].assign(2 * m_part + 2, 0);
+    m_send[1].assign(2 * m_part + 2, 0);
+
+    size_t own = 0;
+
+    for (size_t row = 0; row < m_rows; row++)
+    {
+        own += (StageOf(row * m_every) == m_stage);
+    }
+
+    m_history.assign(own * m_part, 0);
+}
+
+Wavefront::~Wavefront()
+{
+    if (m_space != MPI_COMM_NULL) MPI_Comm_free(&m_space);
+    if (m_time  != MPI_COMM_NULL) MPI_Comm_free(&m_time);
+}
+
+int Wavefront::Init(UserMpi::MPI* master)
+{
+    if (m_commSize % m_stages || m_part < 2)
+    {
+        if (m_rank == 0)
+        {
+            warnx("Wavefront: %d ranks do not split into %d stages of blocks at least two columns wide", m_commSize, m_stages);
+        }
+
+        return 1;
+    }
+
+    master->commSplit(MPI_COMM_WORLD, m_stage, m_block, &m_space);
+    if (master->check()) return 1;
+
+    master->commSplit(MPI_COMM_WORLD, m_block, m_stage, &m_time);
+    if (master->check()) return 1;
+
+    return 0;
+}
+
+int Wavefront::OpenSourceTable(UserMpi::MPI* master, const char* path)
+{
+    return m_table.Open(master, MPI_COMM_WORLD, path, GetHeader(1), m_scheme, *m_kernels);
+}
+
+void Wavefront::Store(size_t k, size_t begin, size_t end)
+{
+    if (k % m_every == 0 && begin < end)
+    {
+        memcpy(m_history.data() + m_stored * m_part + begin, m_next + begin, (end - begin) * sizeof(double));
+    }
+}
+
+int Wavefront::FillInitialConditions()
+{
+    if (StageOf(0) == m_stage)
+    {
+        for (size_t i = 0; i < m_part; i++)
+        {
+            m_next[i] = m_kernels->initial(m_scheme, m_start + i);
+        }
+
+        Store(0, 0, m_part);
+
+        m_stored++;
+    }
+
+    return 0;
+}
+
+int Wavefront::FillFirstLine(UserMpi::MPI* master)
+{
+    if (StageOf(1) != m_stage)
+    {
+        return 0;
+    }
+
+    /* The first line reads only the layer 0, every stage can compute it */
+    for (ptrdiff_t i = (m_block == 0) ? 0 : -1; i < static_cast<ptrdiff_t>(m_part); i++)
+    {
+        m_curr[i] = m_kernels->initial(m_scheme, static_cast<ptrdiff_t>(m_start) + i);
+    }
+
+    return FillLayer(master, 1);
+}
+
+int Wavefront::FillOtherLines(UserMpi::MPI* master)
+{
+    for (size_t k = 2; k < m_K; k++)
+    {
+        if (StageOf(k) == m_stage)
+        {
+            if (FillLayer(master, k)) return 1;
+        }
+    }
+
+    for (std::vector<MPI_Request>& requests : m_requests)
+    {
+        master->waitall(requests.size(), requests.data());
+        if (master->check()) return 1;
+
+        requests.clear();
+    }
+
+    return 0;
+}
+
+int Wavefront::FillLayer(UserMpi::MPI* master, size_t k)
+{
+    /* The buffer of two own layers ago, its messages have been received by now or soon will */
+    master->waitall(m_requests[m_slot].size(), m_requests[m_slot].data());
+    if (master->check()) return 1;
+
+    m_requests[m_slot].clear();
+
+    m_received = 0;
+
+    for (size_t chunk = 0; chunk < Chunks(); chunk++)
+    {
+        if (FillChunk(master, k, chunk)) return 1;
+    }
+
+    if (k % m_every == 0)
+    {
+        m_stored++;
+    }
+
+    m_slot ^= 1;
+
+    return 0;
+}
+
+int Wavefront::Receive(UserMpi::MPI* master, size_t chunk)
+{
+    size_t begin = chunk * m_chunk;
+    size_t count = std::min(m_chunk, m_part - begin);
+
+    master->recv(m_recv.data(), 2 * count, MPI::DOUBLE, RankOf(m_block, (m_stage + m_stages - 1) % m_stages), Main, MPI_COMM_WORLD);
+    if (master->check()) return 1;
+
+    memcpy(m_curr  + begin, m_recv.data(),         count * sizeof(double));
+    memcpy(m_older + begin, m_recv.data() + count, count * sizeof(double));
+
+    return 0;
+}
+
+void Wavefront::Post(UserMpi::MPI* master, const double* data, int count, int block, int stage, int tag)
+{
+    m_requests[m_slot].emplace_back();
+
+    master->isend(data, count, MPI::DOUBLE, RankOf(block, stage), tag, MPI_COMM_WORLD, &m_requests[m_slot].back());
+
+    m_stats.messages++;
+    m_stats.bytes += count * sizeof(double);
+}
+
+int Wavefront::Send(UserMpi::MPI* master, size_t k, size_t chunk)
+{
+    size_t begin = chunk * m_chunk;
+    size_t end   = std::min(begin + m_chunk, m_part);
+    size_t count = end - begin;
+
+    int    stage  = StageOf(k + 1);
+    double* buffer = m_send[m_slot].data();
+
+    memcpy(buffer + 2 * begin,         m_next + begin, count * sizeof(double));
+    memcpy(buffer + 2 * begin + count, m_curr + begin, count * sizeof(double));
+
+    Post(master, buffer + 2 * begin, 2 * count, m_block, stage, Main);
+    if (master->check()) return 1;
+
+    if (chunk == 0 && m_block > 0)
+    {
+        buffer[2 * m_part] = m_next[0];
+
+        Post(master, buffer + 2 * m_part, 1, m_block - 1, stage, Right);
+        if (master->check()) return 1;
+    }
+
+    if (end == m_part && m_block < m_blocks - 1)
+    {
+        buffer[2 * m_part + 1] = m_next[m_part - 1];
+
+        Post(master, buffer + 2 * m_part + 1, 1, m_block + 1, stage, Left);
+        if (master->check()) return 1;
+    }
+
+    return 0;
+}
+
+int Wavefront::FillChunk(UserMpi::MPI* master, size_t k, size_t chunk)
+{
+    const bool first = (m_block == 0);
+    const bool last  = (m_block == m_blocks - 1);
+
+    ptrdiff_t begin = chunk * m_chunk;
+    ptrdiff_t end   = std::min(begin + m_chunk, m_part);
+    ptrdiff_t part  = m_part;
+
+    if (k == 1)
+    {
+        double up   = 0;
+        double down = 0;
+
+        ptrdiff_t from = begin;
+
+        if (begin != 0)
+        {
+            up   = m_next[begin - 1];
+            down = m_curr[begin - 1];
+        }
+        else if (first)
+        {
+            m_next[0] = m_kernels->boundary(m_scheme, 1);
+
+            up   = m_next[0];
+            down = m_curr[0];
+            from = 1;
+        }
+        else
+        {
+            master->recv(&up, 1, MPI::DOUBLE, RankOf(m_block - 1, m_stage), First, MPI_COMM_WORLD);
+            if (master->check()) return 1;
+
+            down = m_curr[-1];
+        }
+
+        m_kernels->firstLine(m_scheme, from, end, m_curr, m_next, up, down);
+
+        if (end == part && !last)
+        {
+            master->send(m_next + part - 1, 1, MPI::DOUBLE, RankOf(m_block + 1, m_stage), First, MPI_COMM_WORLD);
+            if (master->check()) return 1;
+        }
+    }
+    else
+    {
+        /* The right neighbour of the last column is the first column of the next chunk */
+        size_t needed = std::min(chunk + 2, Chunks());
+
+        while (m_received < needed)
+        {
+            if (Receive(master, m_received++)) return 1;
+        }
+
+        int stage = (m_stage + m_stages - 1) % m_stages;
+
+        if (begin == 0 && !first)
+        {
+            master->recv(m_curr - 1, 1, MPI::DOUBLE, RankOf(m_block - 1, stage), Left, MPI_COMM_WORLD);
+            if (master->check()) return 1;
+        }
+
+        if (end == part && !last)
+        {
+            master->recv(m_curr + part, 1, MPI::DOUBLE, RankOf(m_block + 1, stage), Right, MPI_COMM_WORLD);
+            if (master->check()) return 1;
+        }
+
+        ptrdiff_t from = first ? std::max<ptrdiff_t>(begin, 1)        : begin;
+        ptrdiff_t to   = last  ? std::min<ptrdiff_t>(end,   part - 1) : end;
+
+        double*   f     = m_frow.data();
+        ptrdiff_t split = from;
+
+        if (m_table.IsOpen())
+        {
+            /* The padding columns are not in the table */
+            split = std::clamp(static_cast<ptrdiff_t>(m_table.Cols()) - static_cast<ptrdiff_t>(m_start), from, std::max(from, to));
+
+            if (from < split)
+            {
+                memcpy(f + from, m_table.Row(k - 1) + m_start + from, (split - from) * sizeof(double));
+            }
+        }
+
+        m_kernels->sourceRow(m_scheme, k - 1, split, to, f);
+        m_kernels->update(m_scheme, from, to, m_older, m_curr, m_next, f);
+
+        if (begin == 0 && first)
+        {
+            m_next[0] = m_kernels->boundary(m_scheme, k);
+        }
+
+        if (end == part && last)
+        {
+            m_next[part - 1] = m_kernels->edge(m_scheme, k - 1, part - 1, m_curr, m_next);
+        }
+    }
+
+    Store(k, begin, end);
+
+    if (k + 1 < m_K)
+    {
+        return Send(master, k, chunk);
+    }
+
+    return 0;
+}
+
+Output::Header Wavefront::GetHeader(size_t every) const
+{
+    /* Stored rows follow the marching axis, which is x in the inversed mode */
+    size_t rows = (m_K - 1) / every + 1;
+    size_t cols = m_inversed ? m_problem.K() : m_problem.M();
+
+    return Output::MakeHeader(m_inversed ? Output::Layout::XT : Output::Layout::TX, m_inversed,
+                              m_problem.X, m_problem.T,
+                              m_inversed ? m_tau * every : m_h,
+                              m_inversed ? m_h : m_tau * every,
+                              m_inversed ? rows : cols,
+                              m_inversed ? cols : rows);
+}
+
+/**
+ * @note The stages of every block first collect their rows on stage 0, then the blocks
+ *       of stage 0 are gathered on rank 0 the same way as in the Worker.
+ */
+int Wavefront::Gather(UserMpi::MPI* master)
+{
+    std::vector<int> counts(m_stages);
+    std::vector<int> displs(m_stages);
+
+    for (size_t row = 0; row < m_rows; row++)
+    {
+        counts[StageOf(row * m_every)] += m_part;
+    }
+
+    for (int stage = 1; stage < m_stages; stage++)
+    {
+        displs[stage] = displs[stage - 1] + counts[stage - 1];
+    }
+
+    std::vector<double> staged(m_stage == 0 ? m_rows * m_part : 0);
+
+    master->gatherv(m_history.data(), m_history.size(), MPI::DOUBLE, staged.data(), counts.data(), displs.data(), MPI::DOUBLE, 0, m_time);
+    if (master->check()) return 1;
+
+    if (m_stage != 0)
+    {
+        return 0;
+    }
+
+    m_block_history.resize(m_rows * m_part);
+
+    for (size_t row = 0; row < m_rows; row++)
+    {
+        int stage = StageOf(row * m_every);
+
+        memcpy(m_block_history.data() + row * m_part, staged.data() + displs[stage], m_part * sizeof(double));
+
+        displs[stage] += m_part;
+    }
+
+    if (m_collect != Collect::Gather)
+    {
+        return 0;
+    }
+
+    if (m_blocks == 1)
+    {
+        m_result = m_block_history.data();
+        return 0;
+    }
+
+    if (m_rank == 0)
+    {
+        m_gathered.resize(m_rows * m_M);
+        m_result = m_gathered.data();
+    }
+
+    MPI_Datatype column = MPI_DATATYPE_NULL;
+    MPI_Datatype stripe = MPI_DATATYPE_NULL;
+
+    /* The rows of the block placed into the global field, block i starts at column i * m_part */
+    master->typeVector(m_rows, m_part, m_M, MPI::DOUBLE, &column);
+    if (master->check()) return 1;
+
+    master->typeResized(column, 0, m_part * sizeof(double), &stripe);
+    if (master->check()) return 1;
+
+    master->typeCommit(&stripe);
+    if (master->check()) return 1;
+
+    master->gather(m_block_history.data(), m_rows * m_part, MPI::DOUBLE, m_result, 1, stripe, 0, m_space);
+    if (master->check()) return 1;
+
+    master->typeFree(&stripe);
+    master->typeFree(&column);
+
+    return master->check();
+}
+
+int Wavefront::Dump(const char* path, Output::Format format)
+{
+    Output::Header header = GetHeader(m_every);
+
+    FILE* file = fopen(path, "w");
+    if (!file) return 1;
+
+    int status = Output::Dump(file, format, header, {0, 0, m_rows, m_inversed ? header.K : header.M, m_M, m_result});
+
+    fclose(file);
+
+    return status;
+}
+
+int Wavefront::Write(UserMpi::MPI* master, const char* path, Output::Format format)
+{
+    Output::Header header = GetHeader(m_every);
+
+    size_t cols  = m_inversed ? header.K : header.M;
+    size_t local = (m_start < cols) ? std::min(m_part, cols - m_start) : 0;
+
+    std::vector<Output::Block> blocks;
+
+    if (m_stage == 0 && local)
+    {
+        blocks.push_back({0, m_start, m_rows, local, m_part, m_block_history.data()});
+    }
+
+    return Output::Write(master, MPI_COMM_WORLD, path, format, header, blocks);
+}
+
+int Wavefront::Report(UserMpi::MPI* master)
+{
+    unsigned long long local[2] = {m_stats.messages, m_stats.bytes};
+    unsigned long long total[2] = {};
+
+    master->reduce(local, total, 2, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (master->check()) return 1;
+
+    if (m_rank == 0)
+    {
+        printf("Wavefront: %d blocks x %d stages, chunk %lu\n", m_blocks, m_stages, m_chunk);
+        printf("Messages: %llu\n", total[0]);
+        printf("Bytes: %llu\n",    total[1]);
+    }
+
+    return 0;
+}
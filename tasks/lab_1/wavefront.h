@@ -0,0 +1,158 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include <vector>
+#include <memory.h>
+
+#include "user_mpi.h"
+#include "equation.h"
+#include "kernel.h"
+#include "config.h"
+#include "output.h"
+#include "source_table.h"
+
+/**
+ * @brief Space × time wavefront: the ranks form a grid of blocks × stages, rank (block, stage)
+ *        owns the columns of its block on the layers k ≡ stage (mod stages).
+ * @note  Every layer is swept from left to right by chunks of columns. The chunk c of the layer k
+ *        needs only the chunks c - 1, c, c + 1 of the layer k - 1, so the next stage starts the
+ *        layer k + 1 one chunk behind and up to "stages" layers are computed at the same time.
+ *        Every chunk is sent to the next stage together with the layer below it, the block edges
+ *        are sent to the neighbouring blocks of the next stage.
+ */
+class Wavefront
+{
+public:
+    explicit Wavefront(int rank, int commSize, const Config& config);
+
+    Wavefront(const Wavefront& wavefront) = delete;
+
+    ~Wavefront();
+
+    /* Collective: checks the grid of ranks and builds the communicators of blocks and stages */
+    int Init(UserMpi::MPI* master);
+
+    int OpenSourceTable(UserMpi::MPI* master, const char* path);
+
+    int FillInitialConditions();
+
+    int FillFirstLine(UserMpi::MPI* master);
+
+    int FillOtherLines(UserMpi::MPI* master);
+
+    int Dump(const char* path, Output::Format format);
+
+    int Gather(UserMpi::MPI* master);
+
+    int Write(UserMpi::MPI* master, const char* path, Output::Format format);
+
+    int Report(UserMpi::MPI* master);
+
+private:
+    enum Tag
+    {
+        Main,  // a chunk of the layer and of the one below it, to the next stage
+        Left,  // the last column of a block, to the next block of the next stage
+        Right, // the first column of a block, to the previous block of the next stage
+        First, // the last column of the first line, to the next block of the same stage
+    };
+
+    struct Stats
+    {
+        unsigned long long messages;
+        unsigned long long bytes;
+    };
+
+    Output::Header GetHeader(size_t every) const;
+
+    int FillLayer(UserMpi::MPI* master, size_t k);
+
+    int FillChunk(UserMpi::MPI* master, size_t k, size_t chunk);
+
+    int Receive(UserMpi::MPI* master, size_t chunk);
+
+    int Send(UserMpi::MPI* master, size_t k, size_t chunk);
+
+    void Post(UserMpi::MPI* master, const double* data, int count, int block, int stage, int tag);
+
+    void Store(size_t k, size_t begin, size_t end);
+
+    inline int RankOf(int block, int stage) const
+    {
+        return stage * m_blocks + block;
+    }
+
+    inline int StageOf(size_t k) const
+    {
+        return k % m_stages;
+    }
+
+    inline size_t Chunks() const
+    {
+        return (m_part + m_chunk - 1) / m_chunk;
+    }
+
+    int m_rank;
+    int m_commSize;
+
+    Equation::Problem m_problem;
+
+    int m_blocks;
+    int m_stages;
+    int m_block;
+    int m_stage;
+
+    size_t m_start;
+    size_t m_part;
+    size_t m_chunk;
+
+    size_t m_M;
+    size_t m_K;
+
+    double m_tau;
+    double m_h;
+
+    int m_inversed;
+
+    Scheme m_scheme;
+    const Kernels* m_kernels;
+
+    size_t m_every;
+    size_t m_rows;
+
+    Collect m_collect;
+
+    MPI_Comm m_space; // the blocks of one stage
+    MPI_Comm m_time;  // the stages of one block
+
+    /* Layers k - 2, k - 1 and k of the own columns, k - 1 with a ghost cell on each side */
+    std::vector<double> m_layers[3];
+    double* m_older;
+    double* m_curr;
+    double* m_next;
+
+    std::vector<double> m_frow; // source term of the layer being computed
+
+    size_t m_received; // chunks of the current layer already received
+    size_t m_stored;   // own stored rows so far
+
+    /* Messages of the last two own layers, a buffer is reused when its sends are complete */
+    std::vector<double>      m_send[2];
+    std::vector<MPI_Request> m_requests[2];
+    size_t m_slot;
+
+    std::vector<double> m_recv;
+
+    /* The stored rows of the own stage, then the rows of the whole block on stage 0 */
+    std::vector<double> m_history;
+    std::vector<double> m_block_history;
+    std::vector<double> m_gathered;
+    double* m_result;
+
+    SourceTable m_table;
+
+    Stats m_stats;
+
+}; // class Wavefront
+
+#endif // WAVEFRONT_H
@@ -1,10 +1,33 @@
 #include "worker.h"
 
-void Worker::SetPosition()
+#include <omp.h>
+#include <new>
+#include <math.h>
+#include <sched.h>
+#include <type_traits>
+
+/* The output is always double, a float field is widened first */
+template <typename Storage>
+static const double* Widen(const Storage* data, size_t count, std::vector<double>* wide)
 {
-    if (Equation::a * Equation::tau / Equation::h < 1)
+    if constexpr (std::is_same_v<Storage, double>)
     {
-        if (m_rank == 0)
+        return data;
+    }
+    else
+    {
+        wide->assign(data, data + count);
+
+        return wide->data();
+    }
+}
+
+template <typename Storage, typename Compute>
+void Worker<Storage, Compute>::SetPosition()
+{
+    if (m_problem.a * m_problem.tau / m_problem.h < 1)
+    {
+        if (m_rank == 0 && !m_quiet)
         {
             if (m_M < m_K)
             {
@@ -20,7 +43,7 @@ void Worker::SetPosition()
     }
     else
     {
-        if (m_rank == 0)
+        if (m_rank == 0 && !m_quiet)
         {
             if (m_M < m_K)
             {
@@ -39,210 +62,1327 @@ void Worker::SetPosition()
 
     }
 
-    m_M     = (m_M / m_commSize + !!(m_M % m_commSize)) * m_commSize;
-    m_part  =  m_M / m_commSize;
-    m_start =  m_part * m_rank;
-}
+    if (m_rebalance)
+    {
+        /* The parts differ anyway, so no padding: rank i starts with M / P columns, plus one if i < M % P */
+        m_bounds.resize(m_commSize + 1);
 
-int Worker::FillInitialConditions()
-{
-    if (m_rank == 0) 
+        for (int rank = 0; rank <= m_commSize; rank++)
+        {
+            m_bounds[rank] = rank * (m_M / m_commSize) + std::min<size_t>(rank, m_M % m_commSize);
+        }
+
+        m_part  = m_bounds[m_rank + 1] - m_bounds[m_rank];
+        m_start = m_bounds[m_rank];
+    }
+    else
+    {
+        m_M     = (m_M / m_commSize + !!(m_M % m_commSize)) * m_commSize;
+        m_part  =  m_M / m_commSize;
+        m_start =  m_part * m_rank;
+    }
+
+    if (m_commSize == 1)
     {
-        for (size_t i = 0; i < m_K; i++) 
+        m_halo = 0;
+    }
+    else if (m_halo > m_part)
+    {
+        if (m_rank == 0)
         {
-            m_data[i * m_part] = m_inversed ? Equation::Func::phi(m_tau * i) : 
-                                              Equation::Func::psi(m_tau * i);
+            warnx("Halo %lu is wider than the local part, using %lu", m_halo, m_part);
         }
+
+        m_halo = m_part;
+    }
+
+    m_stride = m_part + 2 * m_halo;
+
+    if (m_decimate > 1)
+    {
+        size_t cols = m_inversed ? m_problem.K() : m_problem.M();
+        size_t end  = std::min(m_start + m_part, cols);
+
+        m_skip = (m_decimate - m_start % m_decimate) % m_decimate;
+        m_kept = (m_start + m_skip < end) ? (end - 1 - m_start - m_skip) / m_decimate + 1 : 0;
+        m_cols = (cols - 1) / m_decimate + 1;
+    }
+    else
+    {
+        m_kept = m_part;
+        m_cols = m_M;
     }
 
+    /* Every thread gets at least one interior cell */
+    m_threads = std::max<int>(1, std::min<ptrdiff_t>(m_threads, static_cast<ptrdiff_t>(m_part) - 2));
+}
+
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::FillInitialConditions()
+{
     for (size_t i = 0; i < m_part; i++) 
     {
-        m_data[i] = m_inversed ? Equation::Func::psi(m_h * (m_start + i)) : 
-                                 Equation::Func::phi(m_h * (m_start + i));
+        Row(0)[i] = m_kernels->initial(m_scheme, m_start + i);
     }
 
+    Store(0, 0, m_part);
+    Analyse(0);
+
     return 0;
 }
 
-int Worker::FillFirstLine(UserMpi::MPI* master)
+template <typename Storage, typename Compute>
+void Worker<Storage, Compute>::FillBoundary(size_t k)
 {
-    double up_value = 0;
-    double down_value = 0;
-
-    if (m_rank != 0)
+    if (m_rank == 0) 
     {
-        master->recv(&up_value,   1, MPI::DOUBLE, m_rank - 1, MPI_ANY_TAG, MPI_COMM_WORLD);
-        if (master->check()) return 1;
-        
-        master->recv(&down_value, 1, MPI::DOUBLE, m_rank - 1, MPI_ANY_TAG, MPI_COMM_WORLD);
-        if (master->check()) return 1;
+        Row(k)[0] = m_kernels->boundary(m_scheme, k);
     }
+}
+
+template <typename Storage, typename Compute>
+void Worker<Storage, Compute>::Store(size_t k, ptrdiff_t begin, ptrdiff_t end)
+{
+    if (!m_periods.empty() && k % m_every == 0 && begin < end)
+    {
+        Period& period = m_periods.back();
 
-    for (size_t m = (m_rank == 0); m < m_part; m++) 
+        memcpy(period.data.data() + (k / m_every - period.row) * m_part + begin, Row(k) + begin, (end - begin) * sizeof(Storage));
+    }
+    else if (m_snap && k % m_every == 0 && begin < end && m_decimate > 1)
     {
-        if (m != 0)
+        Storage* snap = m_snap + (k / m_every) * m_kept;
+
+        /* The first stored column at or after begin */
+        ptrdiff_t step  = m_decimate;
+        ptrdiff_t first = m_skip + (begin - static_cast<ptrdiff_t>(m_skip) + step - 1) / step * step;
+
+        for (ptrdiff_t i = first; i < end && static_cast<size_t>(i - m_skip) / m_decimate < m_kept; i += step)
         {
-            up_value   = m_data[m_part + m - 1];
-            down_value = m_data[         m - 1];
+            snap[(i - m_skip) / m_decimate] = Row(k)[i];
         }
+    }
+    else if (m_snap && k % m_every == 0 && begin < end)
+    {
+        memcpy(m_snap + (k / m_every) * m_part + begin, Row(k) + begin, (end - begin) * sizeof(Storage));
+    }
+}
+
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::FillFirstLine(UserMpi::MPI* master)
+{
+    Storage up_value = 0;
+    Storage down_value = 0;
 
-        double first_part  = ( up_value - down_value - m_data[m]) / (2 * m_tau);
-        double second_part = (-up_value - down_value + m_data[m]) / (2 * m_h);
+    if (m_rank != 0)
+    {
+        master->recv(&up_value,   1, Type(), m_left, MPI_ANY_TAG, m_comm);
+        if (master->check()) return 1;
+        
+        master->recv(&down_value, 1, Type(), m_left, MPI_ANY_TAG, m_comm);
+        if (master->check()) return 1;
+    }
 
-        double f_part  = m_inversed ? Equation::Func::f((1 + 0.5) * m_tau, (m_start + m + 0.5) * m_h) :
-                                      Equation::Func::f((m_start + m + 0.5) * m_h, (1 + 0.5) * m_tau);
+    FillBoundary(1);
 
-        m_data[m_part + m] = m_inversed ? 
-            (f_part - Equation::a * first_part -               second_part) * 2 / (Equation::a / m_tau +           1 / m_h) :
-            (f_part -               first_part - Equation::a * second_part) * 2 / (          1 / m_tau + Equation::a / m_h);
+    if (m_rank == 0)
+    {
+        m_kernels->firstLine(m_scheme, 1, m_part, Row(0), Row(1), Row(1)[0], Row(0)[0]);
+    }
+    else
+    {
+        m_kernels->firstLine(m_scheme, 0, m_part, Row(0), Row(1), up_value, down_value);
     }
 
     if (m_rank != m_commSize - 1)
     {
-        master->send(m_data + m_part + m_part - 1, 1, MPI::DOUBLE, m_rank + 1, 0, MPI_COMM_WORLD);
+        master->send(Row(1) + m_part - 1, 1, Type(), m_right, 0, m_comm);
         if (master->check()) return 1;
 
-        master->send(m_data + m_part - 1, 1, MPI::DOUBLE, m_rank + 1, 0, MPI_COMM_WORLD);
+        master->send(Row(0) + m_part - 1, 1, Type(), m_right, 0, m_comm);
         if (master->check()) return 1;
     }
 
-    return 0;
+    Store(1, 0, m_part);
+    Analyse(1);
+
+    return Publish(master, 1);
 }
 
-int Worker::FillOtherLines(UserMpi::MPI* master)
+template <typename Storage, typename Compute>
+void Worker<Storage, Compute>::ThreadRange(ptrdiff_t begin, ptrdiff_t end, ptrdiff_t* thread_begin, ptrdiff_t* thread_end)
 {
-    double recv_value_start = 0;
-    double recv_value_end   = 0;
-    MPI_Request start;
-    MPI_Request end;
+    ptrdiff_t count   = std::max<ptrdiff_t>(end - begin, 0);
+    ptrdiff_t threads = omp_get_num_threads();
+    ptrdiff_t thread  = omp_get_thread_num();
 
-    for (size_t k = 1; k < m_K - 1; k++) 
+    ptrdiff_t base = count / threads;
+    ptrdiff_t rest = count % threads;
+
+    *thread_begin = begin + thread * base + std::min(thread, rest);
+    *thread_end   = *thread_begin + base + (thread < rest);
+}
+
+template <typename Storage, typename Compute>
+template <typename Value>
+void Worker<Storage, Compute>::FirstTouch(Value* data, size_t rows, size_t cols)
+{
+    #pragma omp parallel num_threads(m_threads)
     {
-        if (m_rank != 0)
-        {
-            master->isend(m_data + m_part * k + 0, 1, MPI::DOUBLE, m_rank - 1, 0, MPI_COMM_WORLD);
-            if (master->check()) return 1;
+        ptrdiff_t thread_begin = 0;
+        ptrdiff_t thread_end   = 0;
+        ThreadRange(0, cols, &thread_begin, &thread_end);
 
-            master->irecv(&recv_value_start, 1, MPI::DOUBLE, m_rank - 1, MPI_ANY_TAG, MPI_COMM_WORLD, &start);
-            if (master->check()) return 1;
+        for (size_t row = 0; row < rows; row++)
+        {
+            std::fill(data + row * cols + thread_begin, data + row * cols + thread_end, Value{});
         }
+    }
+}
 
-        if (m_rank != m_commSize - 1) 
-        {
-            master->isend(m_data + m_part * k + m_part - 1, 1, MPI::DOUBLE, m_rank + 1, 0, MPI_COMM_WORLD);
-            if (master->check()) return 1;
+template <typename Storage, typename Compute>
+void Worker<Storage, Compute>::FillCross(size_t k, ptrdiff_t begin, ptrdiff_t end)
+{
+    double*   f     = m_frow + m_halo;
+    ptrdiff_t split = begin;
 
-            master->irecv(&recv_value_end, 1, MPI::DOUBLE, m_rank + 1, MPI_ANY_TAG, MPI_COMM_WORLD, &end);
-            if (master->check()) return 1;
+    if (m_table.IsOpen())
+    {
+        /* The padding columns are not in the table */
+        split = std::clamp(static_cast<ptrdiff_t>(m_table.Cols()) - static_cast<ptrdiff_t>(m_start), begin, end);
+
+        if (begin < split)
+        {
+            memcpy(f + begin, m_table.Row(k) + m_start + begin, (split - begin) * sizeof(double));
         }
+    }
+
+    m_kernels->sourceRow(m_scheme, k, split, end, f);
+    m_kernels->update(m_scheme, begin, end, Row(k - 1), Row(k), Row(k + 1), f);
+}
+
+template <typename Storage, typename Compute>
+void Worker<Storage, Compute>::FillCorner(size_t k)
+{
+    Row(k + 1)[m_part - 1] = m_kernels->edge(m_scheme, k, m_part - 1, Row(k), Row(k + 1));
+}
+
+/**
+ * @note  The interior of every layer is split between the OpenMP threads, the master thread
+ *        alone talks to the neighbours (MPI_THREAD_FUNNELED) and fills the two edge cells.
+ *        The last thread also fills the corner cell, which depends on its own part of the layer.
+ */
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::FillOtherLines(UserMpi::MPI* master)
+{
+    if (m_halo > 0)
+    {
+        return FillOtherLinesDeep(master);
+    }
+
+    /* The first and the last own value out, the neighbours' ones in */
+    Storage send_values[2] = {};
+    Storage recv_values[2] = {};
+
+    UserMpi::Plan plan;
+    MPI_Request   request = MPI_REQUEST_NULL;
+
+    if (BuildHalo(master, &plan, send_values, recv_values, 1)) return 1;
+
+    /* Only the master thread updates status, the other threads learn it from the per-step
+       slot, which alternates so that a late reader never sees the status of the next step */
+    int status    = 0;
+    int errors[2] = {};
+
+    double step = 0;
 
-        for (size_t m = 1; m < m_part - 1; m++) 
+    #pragma omp parallel num_threads(m_threads)
+    for (size_t k = 1; k < m_K - 1; k++) 
+    {
+        /* Every step ends with a barrier, so here the master thread may move the columns */
+        if (m_rebalance && k > 1 && (k - 1) % m_rebalance == 0)
         {
-            double first_part  = (- m_data[m_part * (k - 1) + m]                                 ) / (2 * m_tau);
-            double second_part = (  m_data[m_part *  k      + m + 1] - m_data[m_part * k + m - 1]) / (2 * m_h);
+            #pragma omp master
+            {
+                status |= Rebalance(master, k);
+                errors[k & 1] = status;
+            }
 
-            double f_part = m_inversed ? Equation::Func::f(k * m_tau, (m_start + m) * m_h) :
-                                         Equation::Func::f((m_start + m) * m_h, k * m_tau);
+            #pragma omp barrier
 
-            m_data[m_part * (k + 1) + m] = m_inversed ? (f_part - Equation::a * first_part -               second_part) * 2 * m_tau / Equation::a :
-                                                        (f_part -               first_part - Equation::a * second_part) * 2 * m_tau;
+            if (errors[k & 1]) break;
         }
 
-        if (m_rank != 0)
+        #pragma omp master
         {
-            master->wait(&start);
-            if (master->check()) return 1;
+            if (k > 1)
+            {
+                Analyse(k);
+            }
+
+            step = omp_get_wtime();
 
-            double first_part  = (- m_data[m_part * (k - 1) + 0]                       ) / (2 * m_tau);
-            double second_part = (  m_data[m_part *  k      + 0 + 1] - recv_value_start) / (2 * m_h);
+            FillBoundary(k + 1);
 
-            double f_part = m_inversed ? Equation::Func::f(k * m_tau, (m_start + 0) * m_h) :
-                                         Equation::Func::f((m_start + 0) * m_h, k * m_tau);
+            send_values[0] = Row(k)[0];
+            send_values[1] = Row(k)[m_part - 1];
 
-            m_data[m_part * (k + 1) + 0] = m_inversed ? (f_part - Equation::a * first_part -               second_part) * 2 * m_tau / Equation::a :
-                                                        (f_part -               first_part - Equation::a * second_part) * 2 * m_tau;
+            status |= StartHalo(master, &plan, send_values, recv_values, 1, &request);
         }
-        
-        if (m_rank == m_commSize - 1)
-        {
-            size_t m = m_part - 1;
 
-            double first_part  = (  m_data[m_part * (k + 1) + m - 1] - m_data[m_part * k + m - 1] - m_data[m_part * k + m]) / (2 * m_tau);
-            double second_part = (- m_data[m_part * (k + 1) + m - 1] - m_data[m_part * k + m - 1] + m_data[m_part * k + m]) / (2 * m_h);
+        ptrdiff_t thread_begin = 0;
+        ptrdiff_t thread_end   = 0;
+        ThreadRange(1, m_part - 1, &thread_begin, &thread_end);
 
-            double f_part = m_inversed ? Equation::Func::f((k + 0.5) * m_tau, (m_start + m + 0.5) * m_h) :
-                                        Equation::Func::f((m_start + m + 0.5) * m_h, (k + 0.5) * m_tau);
+        FillCross(k, thread_begin, thread_end);
+        Store(k + 1, thread_begin, thread_end);
 
-            m_data[m_part * (k + 1) + m] = m_inversed ? 
-                (f_part - Equation::a * first_part -               second_part) * 2 / (Equation::a / m_tau +           1 / m_h) :
-                (f_part -               first_part - Equation::a * second_part) * 2 / (          1 / m_tau + Equation::a / m_h);
+        if (m_rank == m_commSize - 1 && thread_end == static_cast<ptrdiff_t>(m_part) - 1 && thread_begin < thread_end)
+        {
+            FillCorner(k);
+            Store(k + 1, m_part - 1, m_part);
         }
-        else
+
+        #pragma omp master
         {
-            size_t m = m_part - 1;
+            m_busy += omp_get_wtime() - step;
 
-            master->wait(&end);
-            if (master->check()) return 1;
+            if (!status)
+            {
+                status |= WaitHalo(master, &plan, recv_values, 1, &request);
+            }
+
+            if (!status)
+            {
+                status |= ReadShared(master, k, recv_values);
+            }
+
+            if (m_rank != 0 && !status)
+            {
+                /* The threads never touch the source term of the edge cells */
+                m_kernels->sourceRow(m_scheme, k, 0, 1, m_frow);
+
+                Row(k + 1)[0] = m_kernels->cross(m_scheme, Row(k - 1)[0], recv_values[0], Row(k)[0 + 1], m_frow[0]);
+            }
+
+            Store(k + 1, 0, 1);
+            
+            if (m_rank != m_commSize - 1 && !status)
+            {
+                size_t m = m_part - 1;
 
-            double first_part  = (- m_data[m_part * (k - 1) + m]                             ) / (2 * m_tau);
-            double second_part = (  recv_value_end               - m_data[m_part * k + m - 1]) / (2 * m_h);
+                m_kernels->sourceRow(m_scheme, k, m, m + 1, m_frow);
 
-            double f_part = m_inversed ? Equation::Func::f(k * m_tau, (m_start + m) * m_h) :
-                                         Equation::Func::f((m_start + m) * m_h, k * m_tau);
+                Row(k + 1)[m] = m_kernels->cross(m_scheme, Row(k - 1)[m], Row(k)[m - 1], recv_values[1], m_frow[m]);
 
-            m_data[m_part * (k + 1) + m] = m_inversed ? (f_part - Equation::a * first_part -               second_part) * 2 * m_tau / Equation::a :
-                                                        (f_part -               first_part - Equation::a * second_part) * 2 * m_tau;
+                Store(k + 1, m, m + 1);
+            }
+
+            if (m_rank == m_commSize - 1 && m_part <= 2)
+            {
+                FillCorner(k);
+                Store(k + 1, m_part - 1, m_part);
+            }
+
+            if (!status)
+            {
+                status |= Publish(master, k + 1);
+            }
+
+            errors[k & 1] = status;
         }
 
+        #pragma omp barrier
+
+        if (errors[k & 1]) break;
     }
 
-    return 0;
+    if (!status)
+    {
+        Analyse(m_K - 1);
+    }
+
+    return status;
 }
 
-int Worker::Dump(FILE* file)
+/**
+ * @brief Temporal blocking: every m_halo steps the neighbours exchange the last two layers
+ *        of the m_halo boundary columns in one message (2 * m_halo - 1 values, the outermost
+ *        cell of the older layer is never read), then the ghost triangle is recomputed
+ *        locally, so the next m_halo layers need no communication.
+ * @note  Cells whose dependency cone stays inside the owned columns are computed by all
+ *        threads while the exchange is in flight, the thin edges are left to the master thread.
+ */
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::FillOtherLinesDeep(UserMpi::MPI* master)
 {
-    if (m_inversed)
+    const ptrdiff_t part = m_part;
+    const ptrdiff_t halo = m_halo;
+
+    const bool left  = (m_rank != 0);
+    const bool right = (m_rank != m_commSize - 1);
+
+    const size_t older = m_halo - 1;
+    const int    count = m_halo + older;
+
+    /* The left side, then the right one */
+    std::vector<Storage> send(2 * count);
+    std::vector<Storage> recv(2 * count);
+
+    Storage* send_left  = send.data();
+    Storage* send_right = send.data() + count;
+    Storage* recv_left  = recv.data();
+    Storage* recv_right = recv.data() + count;
+
+    UserMpi::Plan plan;
+    MPI_Request   request = MPI_REQUEST_NULL;
+
+    if (BuildHalo(master, &plan, send.data(), recv.data(), count)) return 1;
+
+    int status    = 0;
+    int errors[2] = {};
+
+    #pragma omp parallel num_threads(m_threads)
+    for (size_t k = 1; k < m_K - 1; k += m_halo) 
     {
-        std::swap(m_M, m_K);
-        std::swap(m_h, m_tau);
-    }
+        size_t block = (k - 1) / m_halo;
+
+        size_t steps = std::min(m_halo, m_K - 1 - k);
+
+        #pragma omp master
+        {
+            for (size_t j = 0; j < steps; j++)
+            {
+                FillBoundary(k + j + 1);
+            }
+
+            if (left)
+            {
+                memcpy(send_left,         Row(k - 1), older  * sizeof(Storage));
+                memcpy(send_left + older, Row(k),     m_halo * sizeof(Storage));
+            }
 
-    fprintf(file, "X:   %lg\n", Equation::X);
-    fprintf(file, "h:   %lg\n", m_h);
-    fprintf(file, "T:   %lg\n", Equation::T);
-    fprintf(file, "tau: %lg\n", m_tau);
-    fprintf(file, "M:   %lu\n", Equation::M);
-    fprintf(file, "K:   %lu\n", Equation::K);
+            if (right)
+            {
+                memcpy(send_right,         Row(k - 1) + part - halo + 1, older  * sizeof(Storage));
+                memcpy(send_right + older, Row(k)     + part - halo,     m_halo * sizeof(Storage));
+            }
+
+            status |= StartHalo(master, &plan, send.data(), recv.data(), count, &request);
+        }
 
-    for (size_t i = 0; i < m_K; i++)
-    {   
-        if (i >= Equation::K) break;
+        for (size_t j = 0; j < steps; j++)
+        {
+            ptrdiff_t begin = 0;
+            ptrdiff_t end   = 0;
+            ThreadRange(j + 1, part - 1 - static_cast<ptrdiff_t>(j), &begin, &end);
+
+            FillCross(k + j, begin, end);
+
+            #pragma omp barrier
+        }
 
-        for (size_t j = 0; j < m_M; j++)
+        #pragma omp master
         {
-            if (j >= Equation::M) break;
+            if (!status)
+            {
+                status |= WaitHalo(master, &plan, recv.data(), count, &request);
+            }
+
+            if (left)
+            {
+                memcpy(Row(k - 1) - halo + 1, recv_left,         older  * sizeof(Storage));
+                memcpy(Row(k)     - halo,     recv_left + older, m_halo * sizeof(Storage));
+            }
 
-            if (m_inversed)
+            if (right)
             {
-                fprintf(file, "%lg\n", m_result[j * m_K + i]);   
+                memcpy(Row(k - 1) + part, recv_right,         older  * sizeof(Storage));
+                memcpy(Row(k)     + part, recv_right + older, m_halo * sizeof(Storage));
             }
-            else
+
+            for (size_t j = 0; j < steps; j++)
             {
-                fprintf(file, "%lg\n", m_result[i * m_M + j]);
+                ptrdiff_t shrink = halo - 1 - static_cast<ptrdiff_t>(j);
+
+                ptrdiff_t begin = left  ? -shrink       : 1;
+                ptrdiff_t end   = right ? part + shrink : part - 1;
+
+                ptrdiff_t inner_begin = j + 1;
+                ptrdiff_t inner_end   = part - 1 - static_cast<ptrdiff_t>(j);
+
+                if (inner_begin < inner_end)
+                {
+                    FillCross(k + j, begin, inner_begin);
+                    FillCross(k + j, inner_end, end);
+                }
+                else
+                {
+                    FillCross(k + j, begin, end);
+                }
+
+                if (!right)
+                {
+                    FillCorner(k + j);
+                }
+
+                Store(k + j + 1, 0, m_part);
+                Analyse(k + j + 1);
             }
+
+            errors[block & 1] = status;
         }
+
+        #pragma omp barrier
+
+        if (errors[block & 1]) break;
+    }
+
+    return status;
+}
+
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::BuildHalo(UserMpi::MPI* master, UserMpi::Plan* plan, Storage* send, Storage* recv, int count)
+{
+    if (m_exchange == Exchange::Neighbor)
+    {
+        return 0;
+    }
+
+    if (m_exchange == Exchange::Pscw || m_exchange == Exchange::Passive)
+    {
+        return OpenInbox(master, count);
+    }
+
+    /* The neighbours never change, so the exchange is set up once and restarted on every step,
+       the shared exchange keeps the messages for the neighbours on the other nodes */
+    const int neighbors[2] = {m_left, m_right};
+
+    for (int side = 0; side < 2; side++)
+    {
+        if (neighbors[side] == MPI_PROC_NULL || m_peers[side].data) continue;
+
+        plan->send(master, send + side * count, count, Type(), neighbors[side], 0, m_comm);
+        if (master->check()) return 1;
+
+        plan->recv(master, recv + side * count, count, Type(), neighbors[side], MPI_ANY_TAG, m_comm);
+        if (master->check()) return 1;
     }
 
     return 0;
 }
 
-int Worker::Gather(UserMpi::MPI* master)
-{    
-    for (size_t k = 0; k < m_K; k++) 
+/* The neighbourhood collective sends send[0] to the left neighbour and send[1] to the right one */
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::StartHalo(UserMpi::MPI* master, UserMpi::Plan* plan, Storage* send, Storage* recv, int count, MPI_Request* request)
+{
+    if (m_exchange == Exchange::Neighbor)
+    {
+        master->ineighborAlltoall(send, count, Type(), recv, count, Type(), m_comm, request);
+        if (master->check()) return 1;
+    }
+    else if (m_inbox_window != MPI_WIN_NULL)
+    {
+        if (PutHalo(master, send, count)) return 1;
+    }
+    else if (plan->size())
+    {
+        plan->start(master);
+        if (master->check()) return 1;
+    }
+
+    m_stats.messages += m_neighbors;
+    m_stats.bytes    += m_neighbors * count * sizeof(Storage);
+
+    return 0;
+}
+
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::WaitHalo(UserMpi::MPI* master, UserMpi::Plan* plan, Storage* recv, int count, MPI_Request* request)
+{
+    double wait = omp_get_wtime();
+
+    if (m_exchange == Exchange::Neighbor)
+    {
+        master->wait(request);
+        if (master->check()) return 1;
+    }
+    else if (m_inbox_window != MPI_WIN_NULL)
+    {
+        if (TakeHalo(master, recv, count)) return 1;
+    }
+    else if (plan->size())
+    {
+        plan->wait(master);
+        if (master->check()) return 1;
+    }
+
+    m_stats.wait += omp_get_wtime() - wait;
+
+    return 0;
+}
+
+/**
+ * @brief One-sided halo: the neighbours put their edge values straight into the inbox of this rank
+ * @note  The exchanges alternate between two slots per side, so a neighbour one exchange
+ *        ahead never overwrites the values that are not read yet. In the passive mode every
+ *        put is followed by the number of the exchange in the stamp window of the target.
+ */
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::OpenInbox(UserMpi::MPI* master, int count)
+{
+    if (m_commSize == 1)
+    {
+        return 0;
+    }
+
+    m_inbox.assign(4 * count, 0);
+
+    master->winCreate(m_inbox.data(), m_inbox.size() * sizeof(Storage), sizeof(Storage), m_comm, &m_inbox_window);
+    if (master->check()) return 1;
+
+    if (m_exchange == Exchange::Pscw)
     {
-        master->gather(m_data + k * m_part, m_part, MPI::DOUBLE, m_result + k * m_M, m_part, MPI::DOUBLE, 0, MPI_COMM_WORLD);
+        int ranks[2] = {};
+        int size     = 0;
+
+        for (int neighbor : {m_left, m_right})
+        {
+            if (neighbor != MPI_PROC_NULL) ranks[size++] = neighbor;
+        }
+
+        master->groupIncl(m_comm, size, ranks, &m_group);
         if (master->check()) return 1;
+
+        return 0;
     }
 
+    master->winCreate(m_stamps, sizeof(m_stamps), sizeof(m_stamps[0]), m_comm, &m_stamp_window);
+    if (master->check()) return 1;
+
+    master->winLockAll(m_inbox_window);
+    if (master->check()) return 1;
+
+    master->winLockAll(m_stamp_window);
+    if (master->check()) return 1;
+
     return 0;
-}
\ No newline at end of file
+}
+
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::PutHalo(UserMpi::MPI* master, const Storage* send, int count)
+{
+    const int neighbors[2] = {m_left, m_right};
+
+    MPI_Aint slot = (m_exchanges & 1) * 2;
+
+    m_exchanges++;
+
+    if (m_exchange == Exchange::Pscw)
+    {
+        /* Exposes the inbox to the neighbours and opens the access to theirs */
+        master->winPost(m_group, m_inbox_window);
+        if (master->check()) return 1;
+
+        master->winStart(m_group, m_inbox_window);
+        if (master->check()) return 1;
+    }
+
+    /* The left side of this rank is the right side of the left neighbour */
+    for (int side = 0; side < 2; side++)
+    {
+        if (neighbors[side] == MPI_PROC_NULL) continue;
+
+        master->put(send + side * count, count, Type(), neighbors[side], (slot + 1 - side) * count, m_inbox_window);
+        if (master->check()) return 1;
+    }
+
+    if (m_exchange == Exchange::Passive)
+    {
+        for (int side = 0; side < 2; side++)
+        {
+            if (neighbors[side] == MPI_PROC_NULL) continue;
+
+            /* The values must land before the stamp */
+            master->winFlush(neighbors[side], m_inbox_window);
+            if (master->check()) return 1;
+
+            master->accumulate(&m_exchanges, 1, MPI_UNSIGNED_LONG_LONG, neighbors[side], 1 - side, MPI_REPLACE, m_stamp_window);
+            if (master->check()) return 1;
+        }
+    }
+
+    return 0;
+}
+
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::TakeHalo(UserMpi::MPI* master, Storage* recv, int count)
+{
+    const int neighbors[2] = {m_left, m_right};
+
+    MPI_Aint slot = ((m_exchanges - 1) & 1) * 2;
+
+    if (m_exchange == Exchange::Pscw)
+    {
+        master->winComplete(m_inbox_window);
+        if (master->check()) return 1;
+
+        master->winWait(m_inbox_window);
+        if (master->check()) return 1;
+    }
+    else
+    {
+        for (int side = 0; side < 2; side++)
+        {
+            if (neighbors[side] == MPI_PROC_NULL) continue;
+
+            master->winFlush(neighbors[side], m_stamp_window);
+            if (master->check()) return 1;
+
+            /* An atomic read of the own stamp, the neighbour may share the core */
+            for (unsigned long long stamp = 0; ; sched_yield())
+            {
+                master->fetchAndOp(nullptr, &stamp, MPI_UNSIGNED_LONG_LONG, m_rank, side, MPI_NO_OP, m_stamp_window);
+                if (master->check()) return 1;
+
+                master->winFlush(m_rank, m_stamp_window);
+                if (master->check()) return 1;
+
+                if (stamp >= m_exchanges) break;
+            }
+        }
+
+        master->winSync(m_inbox_window);
+        if (master->check()) return 1;
+    }
+
+    for (int side = 0; side < 2; side++)
+    {
+        if (neighbors[side] == MPI_PROC_NULL) continue;
+
+        memcpy(recv + side * count, m_inbox.data() + (slot + side) * count, count * sizeof(Storage));
+    }
+
+    return 0;
+}
+
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::Init(UserMpi::MPI* master)
+{
+    master->cartShift(m_comm, 0, 1, &m_left, &m_right);
+    if (master->check()) return 1;
+
+    m_neighbors = (m_left != MPI_PROC_NULL) + (m_right != MPI_PROC_NULL);
+
+    if (m_exchange == Exchange::Shared && m_commSize > 1)
+    {
+        return MapShared(master);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Moves the layers into an MPI-3 shared window of the ranks on this node
+ * @note  A neighbour on the node waits for the progress flag at the start of the segment
+ *        and reads the edge cell in place, a neighbour on another node still gets messages.
+ *        The neighbours are never more than one layer apart, so the ring of three layers
+ *        is never overwritten under a reader.
+ */
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::MapShared(UserMpi::MPI* master)
+{
+    master->commSplitType(m_comm, MPI_COMM_TYPE_SHARED, m_rank, &m_node);
+    if (master->check()) return 1;
+
+    char* base = nullptr;
+
+    master->winAllocateShared(kFlagBytes + m_layers * m_stride * sizeof(Storage), 1, m_node, &base, &m_window);
+    if (master->check()) return 1;
+
+    delete[] m_data;
+
+    m_done = new (base) std::atomic<unsigned long long>(0);
+    m_data = reinterpret_cast<Storage*>(base + kFlagBytes);
+
+    std::fill(m_data, m_data + m_layers * m_stride, Storage{});
+
+    const int neighbors[2] = {m_left, m_right};
+
+    for (int side = 0; side < 2; side++)
+    {
+        if (neighbors[side] == MPI_PROC_NULL) continue;
+
+        int peer = master->translateRank(m_comm, neighbors[side], m_node);
+        if (master->check()) return 1;
+
+        if (peer == MPI_UNDEFINED) continue;
+
+        MPI_Aint size = 0;
+        int      unit = 0;
+        char*    peer_base = nullptr;
+
+        master->winSharedQuery(m_window, peer, &size, &unit, &peer_base);
+        if (master->check()) return 1;
+
+        m_peers[side].done = reinterpret_cast<const std::atomic<unsigned long long>*>(peer_base);
+        m_peers[side].data = reinterpret_cast<const Storage*>(peer_base + kFlagBytes);
+
+        m_neighbors--;
+    }
+
+    /* One passive epoch for the whole run, the flags order the accesses */
+    master->winLockAll(m_window, MPI_MODE_NOCHECK);
+    if (master->check()) return 1;
+
+    /* Every flag is set before anyone reads it */
+    master->barrier(m_node);
+    if (master->check()) return 1;
+
+    return 0;
+}
+
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::ReadShared(UserMpi::MPI* master, size_t k, Storage* recv)
+{
+    if (!m_done)
+    {
+        return 0;
+    }
+
+    double wait = omp_get_wtime();
+
+    for (int side = 0; side < 2; side++)
+    {
+        const Peer& peer = m_peers[side];
+
+        if (!peer.data) continue;
+
+        /* The neighbour may share the core, so give it the time slice */
+        while (peer.done->load(std::memory_order_acquire) < k)
+        {
+            sched_yield();
+        }
+
+        master->winSync(m_window);
+        if (master->check()) return 1;
+
+        recv[side] = peer.data[(k % m_layers) * m_stride + ((side == 0) ? m_part - 1 : 0)];
+    }
+
+    m_stats.wait += omp_get_wtime() - wait;
+
+    return 0;
+}
+
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::Publish(UserMpi::MPI* master, size_t k)
+{
+    if (!m_done)
+    {
+        return 0;
+    }
+
+    master->winSync(m_window);
+    if (master->check()) return 1;
+
+    m_done->store(k, std::memory_order_release);
+
+    return 0;
+}
+
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::OpenSourceTable(UserMpi::MPI* master, const char* path)
+{
+    /* The table is built in double whatever the precision of the layers */
+    return m_table.Open(master, m_comm, path, GetHeader(1), m_scheme, SelectKernels(m_inversed, true));
+}
+
+template <typename Storage, typename Compute>
+void Worker<Storage, Compute>::OpenPeriod(size_t first, size_t last)
+{
+    Period period{};
+
+    period.row   = (first + m_every - 1) / m_every;
+    period.rows  = (last / m_every + 1 > period.row) ? last / m_every + 1 - period.row : 0;
+    period.start = m_start;
+    period.part  = m_part;
+
+    period.bounds = m_bounds;
+    period.data.resize(period.rows * m_part);
+
+    m_periods.push_back(std::move(period));
+}
+
+/**
+ * @brief Splits the columns in proportion to the speed measured since the last rebalance
+ * @note  Every rank gets the same times, so every rank computes the same new bounds.
+ *        A rank keeps at least one column per thread plus the two edges.
+ */
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::Rebalance(UserMpi::MPI* master, size_t k)
+{
+    static constexpr double tolerance = 0.05;
+
+    std::vector<double> busy(m_commSize);
+
+    master->allgather(&m_busy, 1, MPI::DOUBLE, busy.data(), 1, MPI::DOUBLE, m_comm);
+    if (master->check()) return 1;
+
+    m_busy = 0;
+
+    double mean    = 0;
+    double slowest = 0;
+
+    for (double time : busy)
+    {
+        mean   += time / m_commSize;
+        slowest = std::max(slowest, time);
+    }
+
+    std::vector<size_t> bounds = m_bounds;
+
+    if (slowest > mean * (1 + tolerance) && mean > 0)
+    {
+        size_t least = std::min<size_t>(m_threads + 2, m_M / m_commSize);
+
+        std::vector<double> target(m_commSize);
+        std::vector<size_t> parts (m_commSize);
+
+        double speed = 0;
+
+        for (int rank = 0; rank < m_commSize; rank++)
+        {
+            target[rank] = (m_bounds[rank + 1] - m_bounds[rank]) / std::max(busy[rank], 1e-9);
+            speed += target[rank];
+        }
+
+        ptrdiff_t left = m_M;
+
+        for (int rank = 0; rank < m_commSize; rank++)
+        {
+            target[rank] *= m_M / speed;
+            parts [rank]  = std::max<size_t>(least, target[rank]);
+            left         -= parts[rank];
+        }
+
+        /* Round to the total: add to the most underfed parts, take from the most overfed ones */
+        for (; left != 0; left += (left < 0) ? 1 : -1)
+        {
+            int    best  = -1;
+            double error = 0;
+
+            for (int rank = 0; rank < m_commSize; rank++)
+            {
+                double miss = (left > 0) ? target[rank] - parts[rank] : parts[rank] - target[rank];
+
+                if ((left > 0 || parts[rank] > least) && (best < 0 || miss > error))
+                {
+                    best  = rank;
+                    error = miss;
+                }
+            }
+
+            parts[best] += (left > 0) ? 1 : -1;
+        }
+
+        for (int rank = 0; rank < m_commSize; rank++)
+        {
+            bounds[rank + 1] = bounds[rank] + parts[rank];
+        }
+    }
+
+    if (bounds != m_bounds)
+    {
+        if (Migrate(master, k, bounds)) return 1;
+
+        m_rebalances++;
+    }
+
+    OpenPeriod(k + 1, std::min(m_K - 1, k + m_rebalance));
+
+    return 0;
+}
+
+/* Moves the layers k - 1 and k, which the next step reads, to the new owners of the columns */
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::Migrate(UserMpi::MPI* master, size_t k, const std::vector<size_t>& bounds)
+{
+    size_t start = bounds[m_rank];
+    size_t part  = bounds[m_rank + 1] - start;
+
+    std::vector<int> send_counts(m_commSize);
+    std::vector<int> send_displs(m_commSize);
+    std::vector<int> recv_counts(m_commSize);
+    std::vector<int> recv_displs(m_commSize);
+
+    std::vector<Storage> send(2 * m_part);
+    std::vector<Storage> recv(2 * part);
+
+    for (int rank = 0, sent = 0, received = 0; rank < m_commSize; rank++)
+    {
+        /* Old own columns that the rank gets and the new own columns that it had */
+        size_t out_begin = std::max(m_start,          bounds[rank]);
+        size_t out_end   = std::min(m_start + m_part, bounds[rank + 1]);
+        size_t in_begin  = std::max(start,            m_bounds[rank]);
+        size_t in_end    = std::min(start + part,     m_bounds[rank + 1]);
+
+        size_t out = (out_begin < out_end) ? out_end - out_begin : 0;
+        size_t in  = (in_begin  < in_end)  ? in_end  - in_begin  : 0;
+
+        if (out)
+        {
+            memcpy(send.data() + sent,       Row(k - 1) + out_begin - m_start, out * sizeof(Storage));
+            memcpy(send.data() + sent + out, Row(k)     + out_begin - m_start, out * sizeof(Storage));
+        }
+
+        send_counts[rank] = 2 * out;
+        send_displs[rank] = sent;
+        recv_counts[rank] = 2 * in;
+        recv_displs[rank] = received;
+
+        sent     += 2 * out;
+        received += 2 * in;
+
+        if (rank != m_rank)
+        {
+            m_moved += in;
+        }
+    }
+
+    master->alltoallv(send.data(), send_counts.data(), send_displs.data(), Type(),
+                      recv.data(), recv_counts.data(), recv_displs.data(), Type(), m_comm);
+    if (master->check()) return 1;
+
+    delete[] m_data;
+    delete[] m_frow;
+
+    m_start  = start;
+    m_part   = part;
+    m_stride = part;
+
+    m_scheme.start = start;
+
+    m_data = new Storage[m_layers * m_stride]{};
+    m_frow = new double[m_stride]{};
+
+    for (int rank = 0; rank < m_commSize; rank++)
+    {
+        size_t in_begin = std::max(start, m_bounds[rank]);
+        size_t in       = recv_counts[rank] / 2;
+
+        if (in == 0) continue;
+
+        memcpy(Row(k - 1) + in_begin - start, recv.data() + recv_displs[rank],      in * sizeof(Storage));
+        memcpy(Row(k)     + in_begin - start, recv.data() + recv_displs[rank] + in, in * sizeof(Storage));
+    }
+
+    m_bounds = bounds;
+
+    return 0;
+}
+
+/* Every period is gathered on its own, its rows are placed by the bounds it was computed with */
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::GatherPeriods(UserMpi::MPI* master)
+{
+    std::vector<int> counts(m_commSize);
+    std::vector<int> displs(m_commSize);
+    std::vector<Storage> packed;
+
+    for (const Period& period : m_periods)
+    {
+        if (m_rank == 0)
+        {
+            for (int rank = 0; rank < m_commSize; rank++)
+            {
+                counts[rank] = period.rows * (period.bounds[rank + 1] - period.bounds[rank]);
+                displs[rank] = period.rows * period.bounds[rank];
+            }
+
+            packed.resize(period.rows * m_M);
+        }
+
+        master->gatherv(period.data.data(), period.rows * period.part, Type(), 
+                        packed.data(), counts.data(), displs.data(), Type(), 0, m_comm);
+        if (master->check()) return 1;
+
+        for (int rank = 0; m_rank == 0 && rank < m_commSize; rank++)
+        {
+            size_t part = period.bounds[rank + 1] - period.bounds[rank];
+
+            for (size_t row = 0; row < period.rows; row++)
+            {
+                memcpy(m_result + (period.row + row) * m_M + period.bounds[rank], 
+                       packed.data() + displs[rank] + row * part, part * sizeof(Storage));
+            }
+        }
+    }
+
+    return 0;
+}
+
+template <typename Storage, typename Compute>
+Output::Header Worker<Storage, Compute>::GetHeader(size_t every, size_t decimate) const
+{
+    /* Stored rows follow the marching axis, which is x in the inversed mode */
+    size_t rows = (m_K - 1) / every + 1;
+    size_t cols = ((m_inversed ? m_problem.K() : m_problem.M()) - 1) / decimate + 1;
+
+    return Output::MakeHeader(m_inversed ? Output::Layout::XT : Output::Layout::TX, m_inversed, 
+                              m_problem.X, m_problem.T,
+                              m_inversed ? m_tau * every : m_h * decimate,
+                              m_inversed ? m_h * decimate : m_tau * every,
+                              m_inversed ? rows : cols,
+                              m_inversed ? cols : rows);
+}
+
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::Dump(const char* path, Output::Format format)
+{
+    Output::Header header = GetHeader(m_every, m_decimate);
+
+    FILE* file = fopen(path, "w");
+    if (!file) return 1;
+
+    std::vector<double> wide;
+
+    int status = Output::Dump(file, format, header, {0, 0, m_rows, m_inversed ? header.K : header.M, m_cols,
+                                                     Widen(m_result, m_rows * m_cols, &wide)});
+
+    fclose(file);
+
+    return status;
+}
+
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::Gather(UserMpi::MPI* master)
+{    
+    if (m_result == m_data || m_collect != Collect::Gather)
+    {
+        return 0;
+    }
+
+    if (m_rebalance)
+    {
+        return GatherPeriods(master);
+    }
+
+    if (m_decimate > 1)
+    {
+        return GatherDecimated(master);
+    }
+
+    MPI_Datatype block  = MPI_DATATYPE_NULL;
+    MPI_Datatype column = MPI_DATATYPE_NULL;
+    MPI_Datatype stripe = MPI_DATATYPE_NULL;
+
+    /* The local rows, skipping the ghost zone of the full history */
+    master->typeVector(m_rows, m_part, m_snap ? m_part : m_stride, Type(), &block);
+    if (master->check()) return 1;
+
+    master->typeCommit(&block);
+    if (master->check()) return 1;
+
+    /* The same rows placed into the global field, rank i starts at column i * m_part */
+    master->typeVector(m_rows, m_part, m_M, Type(), &column);
+    if (master->check()) return 1;
+
+    master->typeResized(column, 0, m_part * sizeof(Storage), &stripe);
+    if (master->check()) return 1;
+
+    master->typeCommit(&stripe);
+    if (master->check()) return 1;
+
+    master->gather(History(0), 1, block, m_result, 1, stripe, 0, m_comm);
+    if (master->check()) return 1;
+
+    master->typeFree(&stripe);
+    master->typeFree(&column);
+    master->typeFree(&block);
+
+    return master->check();
+}
+
+/* The ranks keep different numbers of columns, which arrive one strided column at a time */
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::GatherDecimated(UserMpi::MPI* master)
+{
+    std::vector<int> counts(m_commSize);
+    std::vector<int> displs(m_commSize);
+
+    size_t cols = m_inversed ? m_problem.K() : m_problem.M();
+
+    for (int rank = 0; rank < m_commSize; rank++)
+    {
+        size_t start = rank * m_part;
+        size_t end   = std::min(start + m_part, cols);
+        size_t skip  = (m_decimate - start % m_decimate) % m_decimate;
+
+        counts[rank] = (start + skip < end) ? (end - 1 - start - skip) / m_decimate + 1 : 0;
+        displs[rank] = (start + skip) / m_decimate;
+    }
+
+    MPI_Datatype local  = MPI_DATATYPE_NULL;
+    MPI_Datatype column = MPI_DATATYPE_NULL;
+    MPI_Datatype global = MPI_DATATYPE_NULL;
+    MPI_Datatype stripe = MPI_DATATYPE_NULL;
+
+    master->typeVector(m_rows, 1, std::max<size_t>(m_kept, 1), Type(), &local);
+    if (master->check()) return 1;
+
+    master->typeResized(local, 0, sizeof(Storage), &column);
+    if (master->check()) return 1;
+
+    master->typeCommit(&column);
+    if (master->check()) return 1;
+
+    master->typeVector(m_rows, 1, m_cols, Type(), &global);
+    if (master->check()) return 1;
+
+    master->typeResized(global, 0, sizeof(Storage), &stripe);
+    if (master->check()) return 1;
+
+    master->typeCommit(&stripe);
+    if (master->check()) return 1;
+
+    master->gatherv(m_snap, m_kept, column, m_result, counts.data(), displs.data(), stripe, 0, m_comm);
+    if (master->check()) return 1;
+
+    master->typeFree(&stripe);
+    master->typeFree(&global);
+    master->typeFree(&column);
+    master->typeFree(&local);
+
+    return master->check();
+}
+
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::Write(UserMpi::MPI* master, const char* path, Output::Format format)
+{
+    Output::Header header = GetHeader(m_every, m_decimate);
+
+    size_t cols  = m_inversed ? header.K : header.M;
+    size_t local = (m_start < cols) ? std::min(m_part, cols - m_start) : 0;
+
+    std::vector<Output::Block> blocks;
+
+    /* Every block keeps its widened copy until the write */
+    std::vector<std::vector<double>> wide(m_periods.size() + 1);
+
+    auto add = [&](size_t row, size_t col, size_t rows, size_t count, size_t stride, const Storage* data)
+    {
+        const double* values = Widen(data, (rows - 1) * stride + count, &wide[blocks.size()]);
+
+        blocks.push_back({row, col, rows, count, stride, values});
+    };
+
+    for (const Period& period : m_periods)
+    {
+        if (period.rows)
+        {
+            add(period.row, period.start, period.rows, period.part, period.part, period.data.data());
+        }
+    }
+
+    if (m_decimate > 1)
+    {
+        if (m_kept)
+        {
+            add(0, (m_start + m_skip) / m_decimate, m_rows, m_kept, m_kept, m_snap);
+        }
+    }
+    else if (local && !m_rebalance)
+    {
+        add(0, m_start, m_rows, local, m_snap ? m_part : m_stride, History(0));
+    }
+
+    return Output::Write(master, m_comm, path, format, header, blocks);
+}
+
+/* Only the real columns count, the padding is never written */
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::Compare(UserMpi::MPI* master, Worker<double>& reference)
+{
+    size_t cols  = m_inversed ? m_problem.K() : m_problem.M();
+    size_t width = (m_decimate > 1) ? m_kept : (m_start < cols) ? std::min(m_part, cols - m_start) : 0;
+
+    double local_max = 0;
+    double global_max = 0;
+
+    double local[2] = {}; // the squares of the error and of the reference
+    double global[2] = {};
+
+    for (size_t row = 0; row < m_rows; row++)
+    {
+        const Storage* own  = History(row);
+        const double*  ref  = reference.History(row);
+
+        for (size_t i = 0; i < width; i++)
+        {
+            double error = own[i] - ref[i];
+
+            local_max  = std::max(local_max, fabs(error));
+            local[0]  += error  * error;
+            local[1]  += ref[i] * ref[i];
+        }
+    }
+
+    master->reduce(&local_max, &global_max, 1, MPI::DOUBLE, MPI_MAX, 0, m_comm);
+    if (master->check()) return 1;
+
+    master->reduce(local, global, 2, MPI::DOUBLE, MPI_SUM, 0, m_comm);
+    if (master->check()) return 1;
+
+    if (m_rank == 0)
+    {
+        printf("Error: max %lg, relative L2 %lg\n", global_max, (global[1] > 0) ? sqrt(global[0] / global[1]) : 0);
+    }
+
+    return 0;
+}
+
+template <typename Storage, typename Compute>
+int Worker<Storage, Compute>::Report(UserMpi::MPI* master)
+{
+    unsigned long long local[3] = {m_stats.messages, m_stats.bytes, m_moved};
+    unsigned long long total[3] = {};
+
+    master->reduce(local, total, 3, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, m_comm);
+    if (master->check()) return 1;
+
+    if (m_rank == 0 && m_commSize > 1)
+    {
+        /* One value per neighbour on every step */
+        unsigned long long messages = 2ull * (m_commSize - 1) * (m_K - 2);
+        unsigned long long bytes    = messages * sizeof(Storage);
+
+        printf("Halo: %lu\n", m_halo);
+        printf("Messages: %llu (saved %lld)\n", total[0], static_cast<long long>(messages - total[0]));
+        printf("Bytes: %llu (saved %lld)\n",    total[1], static_cast<long long>(bytes    - total[1]));
+    }
+
+    if (m_rank == 0 && m_rebalance)
+    {
+        printf("Rebalanced: %u times, moved %llu columns\n", m_rebalances, total[2]);
+    }
+
+    if (m_analysis.IsOpen())
+    {
+        return m_analysis.Report(master, m_comm);
+    }
+
+    return 0;
+}
+
+/* The precisions of --precision double, float and mixed */
+template class Worker<double, double>;
+template class Worker<float,  float>;
+template class Worker<float,  double>;
+
+/* A member template is not instantiated with its class: FirstTouch of the source row and the layers */
+template void Worker<double, double>::FirstTouch<double>(double* data, size_t rows, size_t cols);
+template void Worker<float,  float >::FirstTouch<double>(double* data, size_t rows, size_t cols);
+template void Worker<float,  float >::FirstTouch<float> (float*  data, size_t rows, size_t cols);
+template void Worker<float,  double>::FirstTouch<double>(double* data, size_t rows, size_t cols);
+template void Worker<float,  double>::FirstTouch<float> (float*  data, size_t rows, size_t cols);
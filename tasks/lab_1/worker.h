@@ -1,42 +1,172 @@
 #ifndef WORKER_H
 #define WORKER_H
 
+#include <atomic>
 #include <vector>
 #include <memory.h>
 #include <unistd.h>
 
 #include "user_mpi.h"
 #include "equation.h"
+#include "kernel.h"
+#include "config.h"
+#include "output.h"
+#include "source_table.h"
+#include "analysis.h"
 
+/**
+ * @brief The columns of the grid split between a line of ranks
+ * @note  The layers are stored as Storage and computed as Compute: double, float, or the mixed
+ *        precision with float layers and double arithmetic. The source term is always double.
+ */
+template <typename Storage = double, typename Compute = Storage>
 class Worker
 {
+    /* Compare reads the layers of the double reference */
+    template <typename, typename>
+    friend class Worker;
+
 public:
-    explicit Worker(int rank, int commSize) :
+    explicit Worker(int rank, int commSize, const Config& config, MPI_Comm comm = MPI_COMM_WORLD) :
         m_rank{rank},
         m_commSize{commSize},
+        m_comm{comm},
+        m_left{MPI_PROC_NULL},
+        m_right{MPI_PROC_NULL},
+        m_neighbors{0},
+        m_exchange{config.exchange},
+        m_quiet{config.quiet},
+        m_node{MPI_COMM_NULL},
+        m_window{MPI_WIN_NULL},
+        m_done{nullptr},
+        m_peers{},
+        m_inbox{},
+        m_inbox_window{MPI_WIN_NULL},
+        m_stamp_window{MPI_WIN_NULL},
+        m_stamps{},
+        m_group{MPI_GROUP_NULL},
+        m_exchanges{0},
+        m_problem{config.problem},
         m_start{0},
         m_part{0},
-        m_M{Equation::M},
-        m_K{Equation::K},
-        m_tau{Equation::tau},
-        m_h{Equation::h},
+        m_M{m_problem.M()},
+        m_K{m_problem.K()},
+        m_tau{m_problem.tau},
+        m_h{m_problem.h},
         m_inversed{0},
+        m_scheme{},
+        m_kernels{nullptr},
+        m_halo{config.halo},
+        m_stride{0},
+        m_every{config.stream ? config.stream : 1},
+        m_layers{0},
+        m_rows{0},
+        m_collect{config.collect},
+        m_decimate{config.decimate ? config.decimate : 1},
+        m_skip{0},
+        m_kept{0},
+        m_cols{0},
+        m_threads{config.threads ? static_cast<int>(config.threads) : 1},
+        m_rebalance{config.rebalance},
+        m_bounds{},
+        m_busy{0},
+        m_rebalances{0},
+        m_moved{0},
+        m_periods{},
         m_data{nullptr},
-        m_result{nullptr}
+        m_frow{nullptr},
+        m_snap{nullptr},
+        m_result{nullptr},
+        m_table{},
+        m_analysis{},
+        m_stats{}
     {
         SetPosition();
 
-        m_data = new double[m_K * m_part]{};
+        m_scheme  = {m_problem.a, m_tau, m_h, static_cast<ptrdiff_t>(m_start), {m_problem.X, m_problem.T}};
+        m_kernels = &SelectKernels<Storage, Compute>(m_inversed, config.evaluator == Evaluator::Batched);
+
+        m_rows = (m_K - 1) / m_every + 1;
+
+        m_frow = new double[m_stride];
+
+        FirstTouch(m_frow, 1, m_stride);
+
+        if (m_rebalance)
+        {
+            /* Columns move between the ranks, the stored rows are kept per period of ownership */
+            m_layers = 3;
+
+            m_data = new Storage[m_layers * m_stride];
+
+            FirstTouch(m_data, m_layers, m_stride);
+
+            OpenPeriod(0, std::min(m_K - 1, 1 + m_rebalance));
+        }
+        else if (config.stream || m_decimate > 1)
+        {
+            /* The cross scheme reads layers k - 1 and k, the deep halo computes m_halo layers ahead */
+            m_layers = std::max<size_t>(3, m_halo + 2);
+
+            m_data = new Storage[m_layers * m_stride];
+            m_snap = new Storage[m_rows * m_kept];
+
+            FirstTouch(m_data, m_layers, m_stride);
+            FirstTouch(m_snap, m_rows,   m_kept);
+        }
+        else
+        {
+            m_layers = m_K;
 
-        if (m_rank == 0)
+            m_data = new Storage[m_K * m_stride];
+
+            FirstTouch(m_data, m_K, m_stride);
+        }
+
+        if (m_rank == 0 && m_collect == Collect::Gather)
         {   
-            m_result = (m_commSize == 1) ? m_data : new double[m_K * m_M];
+            m_result = (m_commSize == 1 && !m_snap && !m_rebalance) ? m_data : new Storage[m_rows * m_cols];
+        }
+
+        if (config.analysis || config.probe_count)
+        {
+            m_analysis.Open(config.analysis, m_inversed, m_every, m_K, m_inversed ? m_problem.K() : m_problem.M(),
+                            m_tau, m_h, config.probes, config.probe_count);
         }
     }
 
     ~Worker()
     {
-        delete[] m_data;
+        if (m_window != MPI_WIN_NULL)
+        {
+            MPI_Win_unlock_all(m_window);
+            MPI_Win_free(&m_window);
+            MPI_Comm_free(&m_node);
+        }
+        else
+        {
+            delete[] m_data;
+        }
+
+        if (m_stamp_window != MPI_WIN_NULL)
+        {
+            MPI_Win_unlock_all(m_inbox_window);
+            MPI_Win_unlock_all(m_stamp_window);
+            MPI_Win_free(&m_stamp_window);
+        }
+
+        if (m_inbox_window != MPI_WIN_NULL)
+        {
+            MPI_Win_free(&m_inbox_window);
+        }
+
+        if (m_group != MPI_GROUP_NULL)
+        {
+            MPI_Group_free(&m_group);
+        }
+
+        delete[] m_snap;
+        delete[] m_frow;
 
         if (m_data != m_result)
         {
@@ -44,22 +174,167 @@ public:
         }
     }
 
+    /* Finds the neighbours in the Cartesian topology of the communicator, maps the shared window */
+    int Init(UserMpi::MPI* master);
+
+    /* Collective: maps the precomputed source term, building the table if needed */
+    int OpenSourceTable(UserMpi::MPI* master, const char* path);
+
     int FillInitialConditions();
 
     int FillFirstLine(UserMpi::MPI* master);
 
     int FillOtherLines(UserMpi::MPI* master);
 
-    int Dump(FILE* file);
+    int Dump(const char* path, Output::Format format);
 
     int Gather(UserMpi::MPI* master);
 
+    int Write(UserMpi::MPI* master, const char* path, Output::Format format);
+
+    int Report(UserMpi::MPI* master);
+
+    /* Collective: the error of the stored layers against the same grid solved in double on the same ranks */
+    int Compare(UserMpi::MPI* master, Worker<double>& reference);
+
+    struct Stats
+    {
+        unsigned long long messages;
+        unsigned long long bytes;
+
+        double wait; // seconds of the master thread in the halo waits
+    };
+
+    inline const Stats& GetStats() const
+    {
+        return m_stats;
+    }
+
 private:
+    /* Stored rows of the layers computed with one partition of the columns */
+    struct Period
+    {
+        size_t row;
+        size_t rows;
+
+        size_t start;
+        size_t part;
+
+        std::vector<size_t> bounds; // the columns of rank i are [bounds[i], bounds[i + 1])
+        std::vector<Storage> data;
+    };
+
+    Output::Header GetHeader(size_t every, size_t decimate = 1) const;
+
     void SetPosition();
 
+    int FillOtherLinesDeep(UserMpi::MPI* master);
+
+    /* The halo of count values per side: send and recv hold the left side, then the right one */
+    int BuildHalo(UserMpi::MPI* master, UserMpi::Plan* plan, Storage* send, Storage* recv, int count);
+
+    int StartHalo(UserMpi::MPI* master, UserMpi::Plan* plan, Storage* send, Storage* recv, int count, MPI_Request* request);
+
+    int WaitHalo(UserMpi::MPI* master, UserMpi::Plan* plan, Storage* recv, int count, MPI_Request* request);
+
+    int OpenInbox(UserMpi::MPI* master, int count);
+
+    int PutHalo(UserMpi::MPI* master, const Storage* send, int count);
+
+    /* Completes the puts of this rank and copies the values put by the neighbours into recv */
+    int TakeHalo(UserMpi::MPI* master, Storage* recv, int count);
+
+    int MapShared(UserMpi::MPI* master);
+
+    /* Waits for the layer k of the neighbours on the node and reads their edge cells into recv */
+    int ReadShared(UserMpi::MPI* master, size_t k, Storage* recv);
+
+    /* Tells the neighbours on the node that the edge cells of the layer k are final */
+    int Publish(UserMpi::MPI* master, size_t k);
+
+    int Rebalance(UserMpi::MPI* master, size_t k);
+
+    int Migrate(UserMpi::MPI* master, size_t k, const std::vector<size_t>& bounds);
+
+    void OpenPeriod(size_t first, size_t last);
+
+    int GatherPeriods(UserMpi::MPI* master);
+
+    int GatherDecimated(UserMpi::MPI* master);
+
+    void FillCross(size_t k, ptrdiff_t begin, ptrdiff_t end);
+
+    void FillCorner(size_t k);
+
+    void FillBoundary(size_t k);
+
+    void Store(size_t k, ptrdiff_t begin, ptrdiff_t end);
+
+    /* NUMA first touch: every thread zeroes its columns of every row, so their pages land on its node */
+    template <typename Value>
+    void FirstTouch(Value* data, size_t rows, size_t cols);
+
+    static inline MPI_Datatype Type()
+    {
+        return UserMpi::TypeOf<Storage>();
+    }
+
+    static void ThreadRange(ptrdiff_t begin, ptrdiff_t end, ptrdiff_t* thread_begin, ptrdiff_t* thread_end);
+
+    inline Storage* Row(size_t k)
+    {
+        return m_data + (k % m_layers) * m_stride + m_halo;
+    }
+
+    inline Storage* History(size_t row)
+    {
+        return m_snap ? m_snap + row * m_kept : Row(row);
+    }
+
+    /* The layer k is final */
+    inline void Analyse(size_t k)
+    {
+        if (m_analysis.IsOpen())
+        {
+            m_analysis.Add(k, Row(k), m_start, m_part);
+        }
+    }
+
     int m_rank;
     int m_commSize;
 
+    MPI_Comm m_comm; // a one-dimensional Cartesian topology
+    int      m_left;
+    int      m_right;
+    int      m_neighbors;
+    Exchange m_exchange;
+    bool     m_quiet;
+
+    /* A neighbour on the same node: its progress flag and its layers in the shared window */
+    struct Peer
+    {
+        const std::atomic<unsigned long long>* done;
+        const Storage* data;
+    };
+
+    /* The segment of every rank in the window: the flag padded to a cache line, then the layers */
+    static constexpr size_t kFlagBytes = 64;
+
+    MPI_Comm m_node; // the ranks of m_comm on this node
+    MPI_Win  m_window;
+    std::atomic<unsigned long long>* m_done; // the last layer with final edge cells
+    Peer     m_peers[2]; // the left side, then the right one, no data off the node
+
+    /* One-sided exchange: the neighbours put into the inbox, slot (exchange parity * 2 + side) */
+    std::vector<Storage> m_inbox;
+    MPI_Win   m_inbox_window;
+    MPI_Win   m_stamp_window;
+    unsigned long long m_stamps[2]; // passive: the last exchange put into every side of the inbox
+    MPI_Group m_group;              // PSCW: the neighbours
+    unsigned long long m_exchanges;
+
+    Equation::Problem m_problem;
+
     size_t m_start;
     size_t m_part;
 
@@ -71,8 +346,44 @@ private:
 
     int m_inversed;
 
-    double* m_data;
-    double* m_result;
+    Scheme m_scheme;
+    const BasicKernels<Storage, Compute>* m_kernels; // specialised for m_inversed
+
+    size_t m_halo;
+    size_t m_stride;
+
+    size_t m_every;
+    size_t m_layers;
+    size_t m_rows;
+
+    Collect m_collect;
+
+    /* The stored columns: every m_decimate-th real column, m_kept of them from the local m_skip */
+    size_t m_decimate;
+    size_t m_skip;
+    size_t m_kept;
+    size_t m_cols; // width of m_result
+
+    int m_threads;
+
+    /* Dynamic rebalancing: every m_rebalance steps the columns are split by the measured speed */
+    size_t m_rebalance;
+    std::vector<size_t> m_bounds;
+    double   m_busy; // time of the master thread outside of the halo waits since the last rebalance
+    unsigned m_rebalances;
+    unsigned long long m_moved;
+    std::vector<Period> m_periods;
+
+    Storage* m_data;
+    double* m_frow; // source term of the layer being computed
+    Storage* m_snap;
+    Storage* m_result;
+
+    SourceTable m_table;
+
+    Analysis m_analysis;
+
+    Stats m_stats;
 
 }; // class Worker
 
@@ -0,0 +1,200 @@
+#ifndef DEQUE_H
+#define DEQUE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <type_traits>
+
+/**
+ * @brief Chase — Lev work-stealing deque: the owner pushes and takes at the bottom,
+ *        the other threads steal at the top, no locks anywhere
+ * @note  The memory orders follow Lê, Pop, Cohen, Zappa Nardelli, "Correct and efficient
+ *        work-stealing for weak memory models" (PPoPP 2013). The array doubles when full,
+ *        the old arrays are kept until the deque is destroyed, so a late thief always reads
+ *        valid memory. A thief may read a slot while the owner rewrites it, so the slots are
+ *        relaxed atomic words; such a thief always loses the CAS on top and drops the value.
+ */
+template <typename T>
+class Deque
+{
+    static_assert(std::is_trivially_copyable_v<T>, "The values are copied word by word");
+
+    static constexpr size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    struct Array
+    {
+        explicit Array(int64_t size) :
+            mask{size - 1},
+            words{new std::atomic<uint64_t>[size * kWords]}
+        {}
+
+        int64_t Size() const
+        {
+            return mask + 1;
+        }
+
+        /* The values travel as words, so T is never default-constructed */
+        void Put(int64_t i, const uint64_t* copy)
+        {
+            std::atomic<uint64_t>* slot = &words[(i & mask) * kWords];
+
+            for (size_t w = 0; w < kWords; w++)
+            {
+                slot[w].store(copy[w], std::memory_order_relaxed);
+            }
+        }
+
+        void Get(int64_t i, uint64_t* copy) const
+        {
+            const std::atomic<uint64_t>* slot = &words[(i & mask) * kWords];
+
+            for (size_t w = 0; w < kWords; w++)
+            {
+                copy[w] = slot[w].load(std::memory_order_relaxed);
+            }
+        }
+
+        const int64_t mask;
+        std::unique_ptr<std::atomic<uint64_t>[]> words;
+    };
+
+public:
+    /* capacity is rounded up to a power of two */
+    explicit Deque(size_t capacity = 64) :
+        m_top{0},
+        m_bottom{0},
+        m_array{nullptr},
+        m_arrays{}
+    {
+        int64_t size = 1;
+
+        while (size < static_cast<int64_t>(capacity))
+        {
+            size *= 2;
+        }
+
+        m_arrays.emplace_back(new Array(size));
+        m_array.store(m_arrays.back().get(), std::memory_order_relaxed);
+    }
+
+    Deque(const Deque& deque) = delete;
+
+    /* Owner only, true if the deque looked empty before, i.e. the thieves may have missed the work */
+    bool Push(const T& value)
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+
+        Array* array = m_array.load(std::memory_order_relaxed);
+
+        if (b - t > array->Size() - 1)
+        {
+            array = Grow(array, t, b);
+        }
+
+        uint64_t copy[kWords] = {};
+        memcpy(copy, &value, sizeof(T));
+
+        array->Put(b, copy);
+
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+
+        return b == t;
+    }
+
+    /* Owner only, the last pushed value */
+    bool Take(T* value)
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+
+        Array* array = m_array.load(std::memory_order_relaxed);
+
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        int64_t t = m_top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        uint64_t copy[kWords] = {};
+        array->Get(b, copy);
+        memcpy(static_cast<void*>(value), copy, sizeof(T));
+
+        if (t == b)
+        {
+            /* The last value, the thieves may race for it */
+            bool won = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+
+            return won;
+        }
+
+        return true;
+    }
+
+    /* Any thread, the oldest value; fails if the deque is empty or another thread got it first */
+    bool Steal(T* value)
+    {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+
+        if (t >= b)
+        {
+            return false;
+        }
+
+        Array* array = m_array.load(std::memory_order_acquire);
+
+        uint64_t copy[kWords] = {};
+        array->Get(t, copy);
+
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return false;
+        }
+
+        memcpy(static_cast<void*>(value), copy, sizeof(T));
+
+        return true;
+    }
+
+private:
+    Array* Grow(Array* array, int64_t t, int64_t b)
+    {
+        Array* grown = new Array(array->Size() * 2);
+
+        for (int64_t i = t; i < b; i++)
+        {
+            uint64_t copy[kWords] = {};
+
+            array->Get(i, copy);
+            grown->Put(i, copy);
+        }
+
+        m_arrays.emplace_back(grown);
+        m_array.store(grown, std::memory_order_release);
+
+        return grown;
+    }
+
+    /* The owner and the thieves write different ends, each on its own cache line */
+    alignas(64) std::atomic<int64_t> m_top;
+    alignas(64) std::atomic<int64_t> m_bottom;
+
+    std::atomic<Array*> m_array;
+
+    std::vector<std::unique_ptr<Array>> m_arrays; // owner only
+
+}; // class Deque
+
+#endif // DEQUE_H
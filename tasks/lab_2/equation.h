@@ -3,6 +3,8 @@
 
 #include <cmath>
 
+#include "simd_math.h"
+
 namespace Equation 
 {
 
@@ -14,6 +16,37 @@ struct Func
         //return std::sin(1 / (x + 20));
     }
 
+    /**
+     * @brief f of four points at once with SimdMath, within 2 ulp of the scalar f
+     * @note  Arguments out of the reduction range go back to libm, lane by lane
+     */
+    static __m256d f(__m256d x)
+    {
+        __m256d arg = _mm256_div_pd(_mm256_set1_pd(1.0), _mm256_mul_pd(x, x));
+
+        const __m256d nosign = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffll));
+        __m256d far = _mm256_cmp_pd(_mm256_and_pd(arg, nosign), _mm256_set1_pd(SimdMath::SinLimit), _CMP_GT_OQ);
+
+        __m256d result = SimdMath::Cos(arg);
+
+        if (!_mm256_movemask_pd(far))
+            return result;
+
+        alignas(32) double lanes[4];
+        alignas(32) double points[4];
+
+        _mm256_store_pd(lanes,  result);
+        _mm256_store_pd(points, x);
+
+        for (size_t j = 0; j < 4; j++)
+        {
+            if (std::fabs(1 / (points[j] * points[j])) > SimdMath::SinLimit)
+                lanes[j] = f(points[j]);
+        }
+
+        return _mm256_load_pd(lanes);
+    }
+
     static constexpr double a = 0.01f;
     static constexpr double b = 1.f;
 
@@ -0,0 +1,791 @@
+#ifndef INTEGRATE_H
+#define INTEGRATE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include <immintrin.h>
+
+#include "deque.h"
+
+namespace Quadrature
+{
+
+/* Stealing rounds before an idle thread parks */
+static constexpr size_t max_spins = 8;
+
+/* Intervals refined at once in the AVX lanes */
+static constexpr size_t n_lanes = 4;
+
+/**
+ * @brief The rule on one interval and its error estimate, the interval is bisected until they agree
+ * @note  Trapezoid: the trapezoid against the two halves, 1 new f per step.
+ *        Simpson:   Simpson against the two halves, f at a, b and the midpoint come with the task,
+ *                   2 new f per step.
+ *        Kronrod:   the 15-point Kronrod rule against its embedded 7-point Gauss rule, no node
+ *                   is shared with the halves, 15 new f per step.
+ */
+enum class Rule
+{
+    Trapezoid,
+    Simpson,
+    Kronrod,
+};
+
+struct RuleName
+{
+    const char* name;
+    Rule rule;
+};
+
+static constexpr RuleName rules[] =
+{
+    {"trapezoid", Rule::Trapezoid},
+    {"simpson",   Rule::Simpson  },
+    {"kronrod",   Rule::Kronrod  },
+};
+
+struct Task
+{
+    double a;
+    double b;
+
+    double fa;
+    double fb;
+    double fm; // Simpson only: f((a + b) / 2)
+
+    /* The estimate of the rule on [a, b], Kronrod computes its own */
+    double s;
+};
+
+/* What a thread did during one integrate */
+struct Thread
+{
+    size_t id;
+
+    ssize_t tasks;
+    ssize_t steals;
+    ssize_t evals; // calls of f, the lanes count only the busy ones
+
+    /* Seconds spent looking for a task, parked included */
+    double idle;
+};
+
+/**
+ * @brief The state of one integrate: the deques, the termination count and the parking lot
+ * @note  Every call owns its Integrator, so calls do not share anything and may run at once.
+ *        F is a template parameter to be inlined into the refinement loop. The lanes need
+ *        an overload of f for __m256d and the trapezoid rule, otherwise the scalar loop runs.
+ */
+template <typename F>
+class Integrator
+{
+    static constexpr bool kBatched = std::is_invocable_r_v<__m256d, const F&, __m256d>;
+
+    /* The argument of Routine */
+    struct Worker
+    {
+        Integrator* integrator;
+        Thread*     self;
+    };
+
+public:
+    /* n_threads > 0, integrate checks it */
+    Integrator(const F& f, double eps, size_t n_threads, Rule rule, size_t lanes) :
+        m_f{f},
+        m_eps{eps},
+        m_rule{rule},
+        m_lanes{(kBatched && rule == Rule::Trapezoid) ? lanes : 1},
+        m_deques{},
+        m_n_active{0},
+        m_n_waiting{0},
+        m_epoch{0},
+        m_done{false},
+        m_sum{0}
+    {
+        pthread_mutex_init(&m_mutex_sum,  nullptr);
+        pthread_mutex_init(&m_mutex_park, nullptr);
+        pthread_cond_init (&m_cond_park,  nullptr);
+
+        for (size_t i = 0; i < n_threads; i++)
+        {
+            m_deques.emplace_back(new Deque<Task>());
+        }
+    }
+
+    Integrator(const Integrator& integrator) = delete;
+
+    ~Integrator()
+    {
+        pthread_mutex_destroy(&m_mutex_sum);
+        pthread_mutex_destroy(&m_mutex_park);
+        pthread_cond_destroy (&m_cond_park);
+    }
+
+    /**
+     * @brief The integral over [a, b], threads[i] gets the counters of the thread i
+     * @note  The calling thread works as the thread 0. If a thread cannot be created,
+     *        the ones already running do its share, the result stays the same.
+     */
+    double Run(double a, double b, std::vector<Thread>* threads)
+    {
+        size_t n_threads = m_deques.size();
+
+        threads->resize(n_threads);
+
+        (*threads)[0] = {0, 0, 0, 0, 0};
+
+        m_deques[0]->Push(FirstTask(a, b, &(*threads)[0].evals));
+
+        /* Thread 0 starts with the whole interval */
+        m_n_active = 1;
+
+        std::vector<Worker>    workers(n_threads);
+        std::vector<pthread_t> pthreads(n_threads);
+
+        size_t n_started = 1;
+
+        for (size_t i = 0; i < n_threads; i++)
+        {
+            if (i) (*threads)[i] = {i, 0, 0, 0, 0};
+
+            workers[i] = {this, &(*threads)[i]};
+        }
+
+        for (; n_started < n_threads; n_started++)
+        {
+            int error = pthread_create(&pthreads[n_started], nullptr, Routine, &workers[n_started]);
+            if (error)
+            {
+                perror("pthread_create");
+                break;
+            }
+        }
+
+        Routine(&workers[0]);
+
+        for (size_t i = 1; i < n_started; i++)
+        {
+            int error = pthread_join(pthreads[i], nullptr);
+            if (error)
+            {
+                perror("pthread_join");
+            }
+        }
+
+        return m_sum;
+    }
+
+private:
+    Task FirstTask(double a, double b, ssize_t* evals) const
+    {
+        switch (m_rule)
+        {
+            case Rule::Trapezoid:
+            {
+                double fa = m_f(a);
+                double fb = m_f(b);
+
+                *evals += 2;
+
+                return {a, b, fa, fb, 0, (fb + fa) / 2 * (b - a)};
+            }
+            case Rule::Simpson:
+            {
+                double fa = m_f(a);
+                double fb = m_f(b);
+                double fm = m_f((a + b) / 2);
+
+                *evals += 3;
+
+                return {a, b, fa, fb, fm, (fa + 4 * fm + fb) * (b - a) / 6};
+            }
+            case Rule::Kronrod:
+            default:
+                return {a, b, 0, 0, 0, 0};
+        }
+    }
+
+    static void* Routine(void* arg)
+    {
+        Worker* worker = static_cast<Worker*>(arg);
+
+        worker->integrator->Integrate(worker->self);
+
+        return nullptr;
+    }
+
+    void Integrate(Thread* self)
+    {
+        uint64_t seed = 0x9e3779b97f4a7c15ull * (self->id + 1);
+
+        /* Thread 0 is counted by Run */
+        bool counted = (self->id == 0);
+
+        double sum = 0;
+
+        switch (m_rule)
+        {
+            case Rule::Trapezoid:
+                if constexpr (kBatched)
+                {
+                    if (m_lanes == n_lanes)
+                    {
+                        sum = RefineLanes(self, &seed, &counted);
+                        break;
+                    }
+                }
+
+                sum = Refine(self, &seed, &counted);
+                break;
+
+            case Rule::Simpson:
+                sum = RefineSimpson(self, &seed, &counted);
+                break;
+
+            case Rule::Kronrod:
+                sum = RefineKronrod(self, &seed, &counted);
+                break;
+        }
+
+        pthread_mutex_lock(&m_mutex_sum);
+        m_sum += sum;
+        pthread_mutex_unlock(&m_mutex_sum);
+    }
+
+    /* One round over the other threads from a random one */
+    bool StealTask(size_t id, uint64_t* seed, Task* task)
+    {
+        size_t n_threads = m_deques.size();
+
+        /* xorshift64 */
+        *seed ^= *seed << 13;
+        *seed ^= *seed >> 7;
+        *seed ^= *seed << 17;
+
+        size_t first = *seed % n_threads;
+
+        for (size_t i = 0; i < n_threads; i++)
+        {
+            size_t victim = (first + i) % n_threads;
+
+            if (victim != id && m_deques[victim]->Steal(task))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Wakes a parked thread after the owner pushed a task, was_empty is what Push returned
+     * @note  A thief also parks after losing the race for a task of a deque that still has more,
+     *        so every push checks for parked threads, not only the one into an empty deque.
+     *        For the empty deque the fence pairs with the one of Steal after m_n_waiting is
+     *        raised: either the parking thread sees the new task on its last round or the owner
+     *        sees it waiting. Otherwise the task was stealable already and a late look at
+     *        m_n_waiting only delays the wake to the next push.
+     */
+    void Publish(bool was_empty)
+    {
+        if (was_empty)
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (m_n_waiting.load(std::memory_order_relaxed) == 0)
+            return;
+
+        pthread_mutex_lock(&m_mutex_park);
+        m_epoch.fetch_add(1, std::memory_order_relaxed);
+        pthread_cond_signal(&m_cond_park);
+        pthread_mutex_unlock(&m_mutex_park);
+    }
+
+    /**
+     * @brief Steals a task, parks when there is none, false once every task is done
+     * @note  A thread counts in m_n_active from the moment it starts looking for a task, so a task
+     *        in a deque or in the hands of a thief always keeps the count above zero. Before
+     *        parking the thread leaves the count: the one that brings it to zero knows that
+     *        no task is left anywhere and wakes all the others to leave, nobody polls for it.
+     */
+    bool FindTask(Thread* self, uint64_t* seed, bool* counted, Task* task)
+    {
+        auto start_time = std::chrono::steady_clock::now();
+
+        bool found = false;
+
+        while (1)
+        {
+            if (!*counted)
+            {
+                m_n_active.fetch_add(1, std::memory_order_acq_rel);
+                *counted = true;
+            }
+
+            for (size_t spin = 0; spin < max_spins && !found; spin++)
+            {
+                found = StealTask(self->id, seed, task);
+
+                if (!found) sched_yield();
+            }
+
+            if (found)
+                break;
+
+            /* The last round after m_n_waiting is raised, see Publish */
+            size_t epoch = m_epoch.load(std::memory_order_acquire);
+            m_n_waiting.fetch_add(1, std::memory_order_seq_cst);
+
+            found = StealTask(self->id, seed, task);
+
+            if (found)
+            {
+                m_n_waiting.fetch_sub(1, std::memory_order_relaxed);
+                break;
+            }
+
+            *counted = false;
+
+            pthread_mutex_lock(&m_mutex_park);
+
+            if (m_n_active.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                m_done = true;
+                pthread_cond_broadcast(&m_cond_park);
+            }
+
+            while (!m_done && epoch == m_epoch.load(std::memory_order_relaxed))
+            {
+                pthread_cond_wait(&m_cond_park, &m_mutex_park);
+            }
+
+            bool done = m_done;
+
+            pthread_mutex_unlock(&m_mutex_park);
+
+            m_n_waiting.fetch_sub(1, std::memory_order_relaxed);
+
+            if (done)
+                break;
+        }
+
+        auto end_time = std::chrono::steady_clock::now();
+        self->idle += std::chrono::duration<double>(end_time - start_time).count();
+
+        if (found)
+            self->steals++;
+
+        return found;
+    }
+
+    /**
+     * @note  The owner bisects depth-first: the left half goes to the bottom of its deque, the right
+     *        one is refined at once, so the thieves take the oldest and widest intervals from the top.
+     */
+    double Refine(Thread* self, uint64_t* seed, bool* counted)
+    {
+        Deque<Task>& deque = *m_deques[self->id];
+
+        double sum = 0;
+
+        ssize_t evals = 0;
+
+        Task task = {0, 0, 0, 0, 0, 0};
+
+        while (1)
+        {
+            if (!deque.Take(&task) && !FindTask(self, seed, counted, &task))
+                break;
+
+            double a  = task.a;
+            double b  = task.b;
+            double fa = task.fa;
+            double fb = task.fb;
+            double s  = task.s;
+
+            while (1)
+            {
+                double c  = (a + b) / 2;
+                double fc = m_f(c);
+
+                evals++;
+
+                double s_ac = (fa + fc) * (c - a) / 2;
+                double s_cb = (fc + fb) * (b - c) / 2;
+
+                double s_acb = s_ac + s_cb;
+
+                if (std::abs(s - s_acb) >= m_eps * std::abs(s_acb) && std::abs(s - s_acb) > std::numeric_limits<double>::epsilon())
+                {
+                    Publish(deque.Push({a, c, fa, fc, 0, s_ac}));
+
+                    a = c;
+                    fa = fc;
+                    s = s_cb;
+                }
+                else
+                {
+                    sum += s_acb;
+                    self->tasks++;
+
+                    break;
+                }
+            }
+        }
+
+        self->evals += evals;
+
+        return sum;
+    }
+
+    /**
+     * @brief Refine with Simpson's rule, the halves reuse f at a, b and the midpoint
+     * @note  A finished interval adds the Richardson correction (s_amb - s) / 15
+     */
+    double RefineSimpson(Thread* self, uint64_t* seed, bool* counted)
+    {
+        Deque<Task>& deque = *m_deques[self->id];
+
+        double sum = 0;
+
+        ssize_t evals = 0;
+
+        Task task = {0, 0, 0, 0, 0, 0};
+
+        while (1)
+        {
+            if (!deque.Take(&task) && !FindTask(self, seed, counted, &task))
+                break;
+
+            double a  = task.a;
+            double b  = task.b;
+            double fa = task.fa;
+            double fb = task.fb;
+            double fm = task.fm;
+            double s  = task.s;
+
+            while (1)
+            {
+                /* The same expressions as for the midpoints of the halves, so fm is f(m) */
+                double m  = (a + b) / 2;
+                double l  = (a + m) / 2;
+                double r  = (m + b) / 2;
+
+                double fl = m_f(l);
+                double fr = m_f(r);
+
+                evals += 2;
+
+                double s_am = (fa + 4 * fl + fm) * (m - a) / 6;
+                double s_mb = (fm + 4 * fr + fb) * (b - m) / 6;
+
+                double s_amb = s_am + s_mb;
+
+                if (std::abs(s - s_amb) >= m_eps * std::abs(s_amb) && std::abs(s - s_amb) > std::numeric_limits<double>::epsilon())
+                {
+                    Publish(deque.Push({a, m, fa, fm, fl, s_am}));
+
+                    a = m;
+                    fa = fm;
+                    fm = fr;
+                    s = s_mb;
+                }
+                else
+                {
+                    sum += s_amb + (s_amb - s) / 15;
+                    self->tasks++;
+
+                    break;
+                }
+            }
+        }
+
+        self->evals += evals;
+
+        return sum;
+    }
+
+    /* The 15-point Kronrod rule and the embedded 7-point Gauss rule on [a, b], QUADPACK's qk15 */
+    void Kronrod(double a, double b, double* kronrod, double* gauss) const
+    {
+        /* The Kronrod nodes on [0, 1], the odd ones are the Gauss nodes */
+        static constexpr double xgk[8] =
+        {
+            0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+            0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+            0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+            0.207784955007898467600689403773245, 0.000000000000000000000000000000000
+        };
+
+        static constexpr double wgk[8] =
+        {
+            0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+            0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+            0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+            0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+        };
+
+        static constexpr double wg[4] =
+        {
+            0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+            0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+        };
+
+        double c = (a + b) / 2;
+        double h = (b - a) / 2;
+
+        double fc = m_f(c);
+
+        double resk = wgk[7] * fc;
+        double resg = wg[3]  * fc;
+
+        for (size_t j = 0; j < 7; j++)
+        {
+            double pair = m_f(c - h * xgk[j]) + m_f(c + h * xgk[j]);
+
+            resk += wgk[j] * pair;
+
+            if (j % 2)
+                resg += wg[j / 2] * pair;
+        }
+
+        *kronrod = resk * h;
+        *gauss   = resg * h;
+    }
+
+    /**
+     * @brief Refine with the Gauss — Kronrod pair: an interval is done once K15 and G7 agree
+     * @note  No node is shared with the halves, so a bisected interval is only a and b
+     */
+    double RefineKronrod(Thread* self, uint64_t* seed, bool* counted)
+    {
+        Deque<Task>& deque = *m_deques[self->id];
+
+        double sum = 0;
+
+        ssize_t evals = 0;
+
+        Task task = {0, 0, 0, 0, 0, 0};
+
+        while (1)
+        {
+            if (!deque.Take(&task) && !FindTask(self, seed, counted, &task))
+                break;
+
+            double a = task.a;
+            double b = task.b;
+
+            while (1)
+            {
+                double kronrod = 0;
+                double gauss   = 0;
+
+                Kronrod(a, b, &kronrod, &gauss);
+
+                evals += 15;
+
+                if (std::abs(kronrod - gauss) >= m_eps * std::abs(kronrod) && std::abs(kronrod - gauss) > std::numeric_limits<double>::epsilon())
+                {
+                    double c = (a + b) / 2;
+
+                    Publish(deque.Push({a, c, 0, 0, 0, 0}));
+
+                    a = c;
+                }
+                else
+                {
+                    sum += kronrod;
+                    self->tasks++;
+
+                    break;
+                }
+            }
+        }
+
+        self->evals += evals;
+
+        return sum;
+    }
+
+    /**
+     * @brief Refine, but every lane holds an interval of its own and one step bisects all of them
+     * @note  Every lane does the same arithmetic as Refine, only f is the __m256d one. An empty
+     *        lane is refilled from the own deque; the thread looks for work elsewhere only when
+     *        all its lanes are empty, until then the empty lanes repeat a finished interval.
+     */
+    double RefineLanes(Thread* self, uint64_t* seed, bool* counted)
+    {
+        Deque<Task>& deque = *m_deques[self->id];
+
+        const __m256d half    = _mm256_set1_pd(0.5);
+        const __m256d nosign  = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffll));
+        const __m256d eps     = _mm256_set1_pd(m_eps);
+        const __m256d epsilon = _mm256_set1_pd(std::numeric_limits<double>::epsilon());
+
+        alignas(32) double a [n_lanes];
+        alignas(32) double b [n_lanes];
+        alignas(32) double fa[n_lanes];
+        alignas(32) double fb[n_lanes];
+        alignas(32) double s [n_lanes];
+
+        alignas(32) double c    [n_lanes];
+        alignas(32) double fc   [n_lanes];
+        alignas(32) double s_ac [n_lanes];
+        alignas(32) double s_acb[n_lanes];
+
+        Task task = {0, 0, 0, 0, 0, 0};
+
+        if (!deque.Take(&task) && !FindTask(self, seed, counted, &task))
+            return 0;
+
+        /* The empty lanes need some interval to repeat, the first one will do */
+        for (size_t j = 0; j < n_lanes; j++)
+        {
+            a [j] = task.a;
+            b [j] = task.b;
+            fa[j] = task.fa;
+            fb[j] = task.fb;
+            s [j] = task.s;
+        }
+
+        /* Bit j is set while the lane j holds an interval */
+        int busy = 1;
+
+        double sum = 0;
+
+        ssize_t evals = 0;
+
+        while (1)
+        {
+            for (size_t j = 0; j < n_lanes; j++)
+            {
+                if (busy & (1 << j))
+                    continue;
+
+                if (!deque.Take(&task) && (busy || !FindTask(self, seed, counted, &task)))
+                    break;
+
+                a [j] = task.a;
+                b [j] = task.b;
+                fa[j] = task.fa;
+                fb[j] = task.fb;
+                s [j] = task.s;
+
+                busy |= 1 << j;
+            }
+
+            if (!busy)
+                break;
+
+            __m256d va  = _mm256_load_pd(a);
+            __m256d vb  = _mm256_load_pd(b);
+            __m256d vfa = _mm256_load_pd(fa);
+            __m256d vfb = _mm256_load_pd(fb);
+            __m256d vs  = _mm256_load_pd(s);
+
+            /* Multiplying by 0.5 is exact, as the division by 2 of Refine */
+            __m256d vc  = _mm256_mul_pd(_mm256_add_pd(va, vb), half);
+            __m256d vfc = m_f(vc);
+
+            __m256d vs_ac  = _mm256_mul_pd(_mm256_mul_pd(_mm256_add_pd(vfa, vfc), _mm256_sub_pd(vc, va)), half);
+            __m256d vs_cb  = _mm256_mul_pd(_mm256_mul_pd(_mm256_add_pd(vfc, vfb), _mm256_sub_pd(vb, vc)), half);
+            __m256d vs_acb = _mm256_add_pd(vs_ac, vs_cb);
+
+            __m256d error = _mm256_and_pd(_mm256_sub_pd(vs, vs_acb), nosign);
+            __m256d split = _mm256_and_pd(_mm256_cmp_pd(error, _mm256_mul_pd(eps, _mm256_and_pd(vs_acb, nosign)), _CMP_GE_OQ),
+                                          _mm256_cmp_pd(error, epsilon, _CMP_GT_OQ));
+
+            int refine = _mm256_movemask_pd(split) & busy;
+
+            evals += __builtin_popcount(busy);
+
+            _mm256_store_pd(c,     vc);
+            _mm256_store_pd(fc,    vfc);
+            _mm256_store_pd(s_ac,  vs_ac);
+            _mm256_store_pd(s_acb, vs_acb);
+
+            for (size_t j = 0; j < n_lanes; j++)
+            {
+                if (refine & (1 << j))
+                {
+                    Publish(deque.Push({a[j], c[j], fa[j], fc[j], 0, s_ac[j]}));
+                }
+                else if (busy & (1 << j))
+                {
+                    sum += s_acb[j];
+                    self->tasks++;
+
+                    busy &= ~(1 << j);
+                }
+            }
+
+            /* The refined lanes go on with their right halves */
+            _mm256_store_pd(a,  _mm256_blendv_pd(va,  vc,    split));
+            _mm256_store_pd(fa, _mm256_blendv_pd(vfa, vfc,   split));
+            _mm256_store_pd(s,  _mm256_blendv_pd(vs,  vs_cb, split));
+        }
+
+        self->evals += evals;
+
+        return sum;
+    }
+
+    const F m_f;
+
+    const double m_eps;
+
+    const Rule m_rule;
+
+    /* 1 or n_lanes */
+    const size_t m_lanes;
+
+    /* Thread i owns m_deques[i], the others steal from it */
+    std::vector<std::unique_ptr<Deque<Task>>> m_deques;
+
+    /* Threads that hold a task or may still find one, none left means no tasks anywhere */
+    std::atomic<size_t> m_n_active;
+
+    /* Parked threads wait for the epoch to change, it changes when work is published or all is done */
+    std::atomic<size_t> m_n_waiting;
+    std::atomic<size_t> m_epoch;
+    bool m_done;
+
+    double m_sum;
+
+    pthread_mutex_t m_mutex_sum;
+    pthread_mutex_t m_mutex_park;
+    pthread_cond_t  m_cond_park;
+
+}; // class Integrator
+
+/**
+ * @brief The integral of f over [a, b] to the relative accuracy eps by the adaptive rule
+ *        on n_threads threads, the calling one included
+ * @note  lanes is 1 or n_lanes, see Integrator. threads, if given, gets the counters
+ *        of every thread. NaN if there are no threads or the lanes are neither.
+ */
+template <typename F>
+double integrate(const F& f, double a, double b, double eps, size_t n_threads, Rule rule = Rule::Trapezoid,
+                 size_t lanes = 1, std::vector<Thread>* threads = nullptr)
+{
+    if (n_threads == 0 || (lanes != 1 && lanes != n_lanes))
+        return std::numeric_limits<double>::quiet_NaN();
+
+    std::vector<Thread> counters;
+
+    Integrator<F> integrator(f, eps, n_threads, rule, lanes);
+
+    return integrator.Run(a, b, threads ? threads : &counters);
+}
+
+}; // namespace Quadrature
+
+#endif // INTEGRATE_H
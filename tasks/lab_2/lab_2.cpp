@@ -1,31 +1,12 @@
 #include "lab_2.h"
 
-struct
-{
-    const ssize_t max_local_size  = 3;
-    const ssize_t max_global_size = 50;
-
-    double eps;
-
-    std::stack<Task> stack;
-    ssize_t n_task;
-
-    double sum;
-
-    size_t n_active;
-
-    pthread_mutex_t mutex_sum;
-    pthread_mutex_t mutex_stack;
-    pthread_mutex_t mutex_active;
-
-} shared;
-
 int main(int argc, char* argv[])
 {
-    if (argc != 3) 
+    if (argc < 3 || argc > 5) 
     {
-        printf("Enter K number of threads and epsilon\n"
-               "For example: ./a.out 10\n");
+        printf("Enter K number of threads, epsilon and optionally the lanes (1 or %lu)\n"
+               "and the rule (trapezoid, simpson or kronrod)\n"
+               "For example: ./a.out 10 1e-9 1 simpson\n", Quadrature::n_lanes);
         return 0;
     }
 
@@ -35,193 +16,74 @@ int main(int argc, char* argv[])
     if ((errno == ERANGE) || (*end != '\0'))
         return 1;
 
-    InitSharedMemory(std::atof(argv[2]));
-
-    std::vector<pthread_t> pthreads(K);
-    std::vector<ssize_t> tasks(K);
+    if (K == 0)
+        return 1;
 
-    auto start_time = std::chrono::high_resolution_clock::now();
+    unsigned long lanes = 1;
 
-    int error = 0;
-    for (unsigned long i = 0; i < K; i++)
+    if (argc >= 4)
     {
-        error = pthread_create(&pthreads[i], nullptr, routine_integrate, &tasks[i]);
-        if (error)
-        {
-            perror("pthread_create");
+        lanes = strtoul(argv[3], &end, 10);
+
+        if ((errno == ERANGE) || (*end != '\0'))
+            return 1;
+
+        if (lanes != 1 && lanes != Quadrature::n_lanes)
             return 1;
-        }
     }
 
-    for (unsigned long i = 0; i < K; i++)
+    Quadrature::Rule rule = Quadrature::Rule::Trapezoid;
+
+    if (argc == 5)
     {
-        error = pthread_join(pthreads[i], nullptr);
-        if (error)
-        {
-            perror("pthread_join");
+        size_t i = 0;
+        size_t n_rules = sizeof(Quadrature::rules) / sizeof(Quadrature::rules[0]);
+
+        while (i < n_rules && strcmp(argv[4], Quadrature::rules[i].name))
+            i++;
+
+        if (i == n_rules)
             return 1;
-        }
-    }
 
-    auto end_time = std::chrono::high_resolution_clock::now();
-    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+        rule = Quadrature::rules[i].rule;
+    }
 
-    for (size_t i = 0; i < K; i++)
+    /* Simpson and Kronrod have no lanes, they would run scalar */
+    if (lanes != 1 && rule != Quadrature::Rule::Trapezoid)
     {
-        printf("tasks: %lu\n", tasks[i]);
+        printf("The lanes are for the trapezoid rule only\n");
+        return 1;
     }
 
-    printf("%.12lf\n", shared.sum);
-    // std::cout << "Result: " << shared.sum << std::endl;
-    //std::cout << std::fixed << "Result: " << std::setprecision(-std::ceil(std::log10(shared.eps))) << shared.sum << std::endl;
-    std::cout << "Time: " << static_cast<double>(elapsed_ms.count()) / 1000.f << std::endl;
+    double eps = std::atof(argv[2]);
 
-    DestroySharedMemory();
+    std::vector<Quadrature::Thread> threads;
 
-    return 0;
-}
+    auto start_time = std::chrono::high_resolution_clock::now();
 
-void* routine_integrate(void* arg)
-{
-    std::stack<Task> lstack;
-    ssize_t n_task = 0;
+    /* The lanes take the __m256d overload of f */
+    double sum = Quadrature::integrate([](auto x) { return Equation::Func::f(x); },
+                                       Equation::Func::a, Equation::Func::b, eps, K, rule, lanes, &threads);
 
-    ssize_t tasks = 0;
+    auto end_time = std::chrono::high_resolution_clock::now();
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
 
-    double sum = 0;
+    ssize_t evals = 0;
 
-    while (1)
+    for (size_t i = 0; i < K; i++)
     {
-        if (n_task == 0)
-        {
-            pthread_mutex_lock(&shared.mutex_stack);
-            if (shared.n_task > 0)
-            {
-                shared.n_task--;
-                lstack.push(shared.stack.top());
-                n_task++;
-                shared.stack.pop();
-                
-                pthread_mutex_lock(&shared.mutex_active);
-                shared.n_active++;
-                pthread_mutex_unlock(&shared.mutex_active);
-            }
-            pthread_mutex_unlock(&shared.mutex_stack);
-        }
-
-        if (n_task > 0)
-        {
-            struct Task task = lstack.top();
-            lstack.pop();
-            n_task--;
-
-            double a  = task.a;
-            double b  = task.b;
-            double fa = task.fa;
-            double fb = task.fb;
-            double s  = task.s;
-
-            while (1)
-            {
-                double c  = (a + b) / 2;
-                double fc = Equation::Func::f(c);
-
-                double s_ac = (fa + fc) * (c - a) / 2;
-                double s_cb = (fc + fb) * (b - c) / 2;
-
-                double s_acb = s_ac + s_cb;
-
-                if (std::abs(s - s_acb) >= shared.eps * std::abs(s_acb) && std::abs(s - s_acb) > std::numeric_limits<double>::epsilon())
-                {
-                    lstack.push({a, c, fa, fc, s_ac});
-                    n_task++;
-
-                    a = c;
-                    fa = fc;
-                    s = s_cb;
-
-                    if (n_task > shared.max_local_size && shared.n_task == 0)
-                    {
-                        while (n_task > 1 && shared.n_task < shared.max_global_size)
-                        {
-                            pthread_mutex_lock(&shared.mutex_stack);
-                            shared.stack.push(lstack.top());
-                            shared.n_task++;
-                            pthread_mutex_unlock(&shared.mutex_stack);
-
-                            lstack.pop();
-                            n_task--;
-                        }
-                    }
-                }
-                else
-                {
-                    sum += s_acb;
-                    tasks++;
-
-                    if (n_task == 0)
-                    {
-                        pthread_mutex_lock(&shared.mutex_active);
-                        shared.n_active--;
-                        pthread_mutex_unlock(&shared.mutex_active);
-
-                        break;
-                    }
-
-                    task = lstack.top();
-                    lstack.pop();
-                    n_task--;
-
-                    a  = task.a;
-                    b  = task.b;
-                    fa = task.fa;
-                    fb = task.fb;
-                    s  = task.s;
-                }
-            }
-        }
-
-        if (n_task == 0)
-        {
-            pthread_mutex_lock(&shared.mutex_active);
-            if (shared.n_active == 0 && shared.n_task == 0)
-            {   
-                pthread_mutex_unlock(&shared.mutex_active);
-                break;
-            }
-            pthread_mutex_unlock(&shared.mutex_active);
-        }
-    }
-
-    pthread_mutex_lock(&shared.mutex_sum);
-    shared.sum += sum;
-    pthread_mutex_unlock(&shared.mutex_sum);
-    
-    *(ssize_t*)(arg) = tasks;
+        printf("tasks: %zd, steals: %zd, evals: %zd, idle: %.3lf\n", threads[i].tasks, threads[i].steals, threads[i].evals, threads[i].idle);
 
-    pthread_exit(NULL);
-}
-
-void InitSharedMemory(double eps)
-{
-    shared.eps = eps;
-    
-    pthread_mutex_init(&shared.mutex_stack,  nullptr);
-    pthread_mutex_init(&shared.mutex_sum,    nullptr);
-    pthread_mutex_init(&shared.mutex_active, nullptr);
+        evals += threads[i].evals;
+    }
 
-    shared.sum = 0;
+    printf("%.12lf\n", sum);
+    // std::cout << "Result: " << sum << std::endl;
+    //std::cout << std::fixed << "Result: " << std::setprecision(-std::ceil(std::log10(eps))) << sum << std::endl;
+    std::cout << "Time: " << static_cast<double>(elapsed_ms.count()) / 1000.f << std::endl;
 
-    shared.n_active = 0;
+    /* script.py takes the Time line as the one after the K thread lines and the sum, so extra output goes after it */
+    printf("Evaluations: %zd\n", evals);
 
-    struct Task init{};
-    shared.stack.push(init);
-    shared.n_task = 1;
+    return 0;
 }
-
-void DestroySharedMemory()
-{
-    pthread_mutex_destroy(&shared.mutex_stack);
-    pthread_mutex_destroy(&shared.mutex_sum);
-    pthread_mutex_destroy(&shared.mutex_active);
-}
\ No newline at end of file